@@ -1,99 +1,25 @@
 #include "analysis.h"
+#include "analysis_internal.h"
 #include "counters.h"
 #include "memo.h"
 #include "state.h"
+#include "stats.h"
+#include "trace.h"
 
 #include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
-#include <iomanip>
 #include <optional>
 #include <random>
+#include <sstream>
 #include <span>
 #include <vector>
 
-// Enable to collect detailed statistics.
-#define COLLECT_STATS 0
-
 namespace {
 
-#if COLLECT_STATS
-
-constexpr int percentiles[] = {0, 10, 20, 30, 40, 50, 60, 70, 80, 90, 91, 92, 93, 94, 95, 96, 97, 98, 99, 100};
-
-std::vector<int> stats_solutions;
-std::vector<int> stats_positions;
-std::vector<int> stats_moves;
-std::vector<int> stats_winning_positions;
-std::vector<int> stats_winning_solutions;
-
-void DumpStats(std::vector<int> &stats) {
-  assert(!stats.empty());
-  std::cout << std::setw(9) << stats.size()
-      << std::fixed << std::setw(6) << std::setprecision(1)
-      << 1.0*std::accumulate(stats.begin(), stats.end(), uint64_t{0}) / stats.size();
-  std::ranges::sort(stats);
-  for (int percentile : percentiles) {
-    std::cout << std::setw(6) << stats[(uint64_t{stats.size()} - 1) * percentile / 100];
-  }
-}
-
-void DumpStats() {
-  std::cout << "            " << std::setw(9) << "samples" << std::setw(6) << "avg.";
-  for (int percentile : percentiles) {
-    std::cout << std::setw(5) << percentile << '%';
-  }
-  std::cout << "\nwin. sols   "; DumpStats(stats_winning_solutions);
-  std::cout << "\nrem. sols   "; DumpStats(stats_solutions);
-  std::cout << "\nrem. posits "; DumpStats(stats_positions);
-  std::cout << "\nrem. moves  "; DumpStats(stats_moves);
-  std::cout << std::endl;
-}
-
-#endif // COLLECT_STATS
-
-using position_t = int_fast8_t;
-
-memo_t memo;
-
-struct HashedSolution {
-  memo_key_t hash;
-  solution_t solution;
-};
-
-constexpr uint64_t Fnv1a_64(std::span<const uint8_t> bytes) {
-  uint64_t hash = 0xcbf29ce484222325;
-  for (uint8_t byte : bytes) {
-    hash ^= byte;
-    hash *= 0x100000001b3;
-  }
-  return hash;
-}
-
-memo_key_t Hash(const solution_t &solution) {
-  static_assert(std::is_same<memo_key_t, uint64_t>::value);
-  return Fnv1a_64(solution);
-}
-
-// Note: this is an order-independent hash! All permutations of solutions
-// have the same hash value. That's intentional, since the span of solutions
-// is supposed to model a set of solutions, not an ordered sequence.
-memo_key_t HashSolutionSet(std::span<const HashedSolution> solutions) {
-  memo_key_t hash = 0;
-  for (const auto &entry : solutions) hash ^= entry.hash;
-  return hash;
-}
-
-// For each cell, calculates a bitmask of possible digits.
-candidates_t CalculateCandidates(std::span<const solution_t> solutions) {
-  candidates_t candidates = {};
-  for (const solution_t &solution : solutions) {
-    for (int i = 0; i < 81; ++i) candidates[i] |= 1u << solution[i];
-  }
-  return candidates;
-}
-
-constexpr bool Determined(unsigned mask) { return (mask & (mask - 1)) == 0; }
+using namespace analysis::internal;
 
 template<typename T> std::vector<T> Remove(std::span<const T> v, T i) {
   std::vector<T> res;
@@ -102,47 +28,6 @@ template<typename T> std::vector<T> Remove(std::span<const T> v, T i) {
   return res;
 }
 
-// std::span<T> wrapper that allows iteration in sorted order.
-//
-// Construction takes O(N) time, dereferencing an iterator takes O(1) time
-// and incrementing an iterator takes O(log N) time.
-//
-// This is useful in the case where it is unlikely that the entire range
-// is iterated over.
-//
-// Note that the elements of the span are reordered during iteration!
-template<class T> class SortingIterable {
-  struct Iterator {
-    std::span<T>::iterator begin, end;
-
-    T &operator*() { return *begin; }
-
-    Iterator &operator++() {
-      std::pop_heap(begin, end, std::greater<T>());
-      --end;
-      return *this;
-    }
-
-    bool operator==(const Iterator &o) const { return end == o.end; }
-  };
-
-public:
-  explicit SortingIterable(std::span<T> data) : data(data) {};
-
-  Iterator begin() {
-    std::make_heap(data.begin(), data.end(), std::greater<T>());
-    return Iterator{data.begin(), data.end()};
-  }
-
-  Iterator end() {
-    return Iterator{data.begin(), data.begin()};
-  }
-
-private:
-
-  std::span<T> data;
-};
-
 /*
 
 // Rearranges the span of solutions into three parts:
@@ -188,13 +73,6 @@ void SortByDigitAtPosition(std::span<HashedSolution> solutions, position_t pos)
 
 */
 
-std::span<HashedSolution> FilterSolutions(std::span<HashedSolution> solutions, Move move) {
-  return std::span<HashedSolution>(
-    solutions.begin(),
-    std::partition(solutions.begin(), solutions.end(),
-        [move](const auto &s) { return s.solution[move.pos] == move.digit; }));
-}
-
 std::span<position_t> FilterPositions(std::span<position_t> positions, position_t pos) {
   for (position_t &p : positions) {
     if (p == pos) {
@@ -208,45 +86,436 @@ std::span<position_t> FilterPositions(std::span<position_t> positions, position_
 
 constexpr int max_moves = 9 * 9 * 9;
 
-struct RankedMove {
-  Move move;
-  int solution_count;
+// Detects moves that select the same subset of solutions as an earlier move.
+//
+// Different moves often select exactly the same subset, for example when two
+// cells are perfectly correlated within the current solution set. Only the
+// first such move needs to be searched. Subsets are identified by a nonzero
+// 64-bit key: the hash of the subset (like the memo key) or its bitmask.
+//
+// This is a small open-addressing hash table, which is only cleared up to the
+// size needed for the given maximum number of moves.
+class DuplicateMoveFilter {
+public:
+  explicit DuplicateMoveFilter(size_t max_size)
+      : shift(64 - std::bit_width(2*max_size - 1)) {
+    assert(max_size > 0 && max_size <= max_moves);
+    std::fill(table, table + (size_t{1} << (64 - shift)), 0);
+  }
+
+  // Returns true if the key was not seen before.
+  bool Insert(uint64_t key) {
+    assert(key != 0);
+    const size_t mask = (size_t{1} << (64 - shift)) - 1;
+    for (size_t i = (key * 0x9e3779b97f4a7c15) >> shift; ; i = (i + 1) & mask) {
+      if (table[i] == key) return false;
+      if (table[i] == 0) {
+        table[i] = key;
+        return true;
+      }
+    }
+  }
 
-  auto operator<=>(const RankedMove &o) const { return solution_count <=> o.solution_count; }
+private:
+  int shift;
+  uint64_t table[2048];
 };
 
-// Generates stably sorted ranked moves, sorted by increasing solution count.
-// This may include immediately winning moves with solution count == 1, which
-// will necessarily appear at the front of the list.
-std::vector<RankedMove> GenerateRankedMoves(
-    std::span<HashedSolution> solutions,
-    std::span<const position_t> choice_positions) {
-  std::vector<RankedMove> moves;
-  for (position_t pos : choice_positions) {
-    int solution_count[9] = {};
-    for (const auto &entry : solutions) {
-      ++solution_count[entry.solution[pos] - 1];
+// Memo hints (see memo.h) identify the move that was being searched when the
+// search of a position was aborted, so that it can be searched first when the
+// position is searched again: in a later batch, or in a later turn.
+int MoveHint(const Move &move) {
+  return 1 + 9*move.pos + (move.digit - 1);
+}
+
+// Makes the move identified by the hint the first move returned by
+// SortingIterable, by setting its solution count to 0 (which is otherwise
+// unused during the search).
+void ApplyMoveHint(std::span<RankedMove> moves, int hint) {
+  if (hint == 0) return;
+  for (RankedMove &move : moves) {
+    if (MoveHint(move.move) == hint) {
+      move.solution_count = 0;
+      counters.hint_tried.Inc();
+      return;
+    }
+  }
+}
+
+// Solution sets of at most 64 solutions are searched with bitmasks over
+// solution indices instead of spans of solutions: filtering by a move is a
+// bitwise AND, and counting the solutions for a move is a popcount. Since most
+// nodes in the search tree are small, this is the common case.
+struct SmallSolutionSet {
+  using mask_t = uint64_t;
+  static constexpr size_t max_size = 64;
+  static_assert(max_size == max_canonical_memo_size);
+
+  // Bitmask of the solutions with the given digit at the given position. Only
+  // valid for the choice positions passed to the constructor.
+  mask_t masks[81][10];
+  memo_key_t hashes[max_size];
+
+  SmallSolutionSet(
+      std::span<const HashedSolution> solutions,
+      std::span<const position_t> choice_positions) {
+    assert(solutions.size() <= max_size);
+    for (position_t pos : choice_positions) {
+      std::fill(std::begin(masks[pos]), std::end(masks[pos]), 0);
+    }
+    for (size_t i = 0; i < solutions.size(); ++i) {
+      hashes[i] = solutions[i].hash;
+      for (position_t pos : choice_positions) {
+        masks[pos][solutions[i].solution[pos]] |= mask_t{1} << i;
+      }
+    }
+  }
+
+  static mask_t AllMask(size_t size) {
+    return size == max_size ? ~mask_t{0} : (mask_t{1} << size) - 1;
+  }
+
+  // Same as HashSolutionSet() over the solutions in the mask.
+  memo_key_t Hash(mask_t mask) const {
+    memo_key_t hash = 0;
+    for (; mask; mask &= mask - 1) hash ^= hashes[std::countr_zero(mask)];
+    return hash;
+  }
+};
+
+// Calculates canonical memo keys for small solution sets.
+//
+// The value of a position depends only on the family of subsets of solutions
+// that the moves select, not on which cells and digits select them. Positions
+// whose families are isomorphic (equal up to a permutation of the solutions)
+// therefore have the same value, even when they come from different grids or
+// games, but HashSolutionSet() gives them unrelated keys.
+//
+// The canonical key is calculated by ordering the solutions canonically, using
+// color refinement, and individualizing solutions when refinement alone does
+// not distinguish all of them. The key is a hash of the family relabeled in
+// the lexicographically smallest order found. That search is exponential for
+// very symmetric families, so it gives up after max_leaves orders, in which
+// case there is no canonical key.
+class CanonicalKey {
+public:
+  using mask_t = SmallSolutionSet::mask_t;
+
+  static constexpr int max_leaves = 16;
+
+  // `subsets` must be distinct subsets of `solutions`.
+  CanonicalKey(mask_t solutions, std::span<const mask_t> subsets)
+      : solutions(solutions), subsets(subsets) {
+    assert(subsets.size() <= max_moves);
+  }
+
+  std::optional<memo_key_t> Calculate() {
+    uint8_t colors[64] = {};
+    Search(colors);
+    if (leaves > max_leaves) return {};
+    // The salt separates canonical keys from the keys of HashSolutionSet().
+    uint64_t hash = Mix(0x6361'6e6f'6e69'6361 ^ std::popcount(solutions));
+    for (size_t i = 0; i < subsets.size(); ++i) hash = Mix(hash ^ best[i]);
+    return hash;
+  }
+
+private:
+  static uint64_t Mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111eb;
+    x ^= x >> 31;
+    return x;
+  }
+
+  // Refines the coloring of the solutions until it is stable. The color of a
+  // solution is the index of its color class in canonical order, so colors do
+  // not depend on the original order of the solutions (or the subsets).
+  void Refine(uint8_t colors[64]) const {
+    int class_count = 0;
+    for (;;) {
+      uint64_t signatures[64] = {};
+      for (mask_t subset : subsets) {
+        uint64_t hash = 0;
+        for (mask_t m = subset; m; m &= m - 1) hash += Mix(colors[std::countr_zero(m)] + 1);
+        hash = Mix(hash);
+        for (mask_t m = subset; m; m &= m - 1) signatures[std::countr_zero(m)] += hash;
+      }
+      uint8_t order[64];
+      int n = 0;
+      for (mask_t m = solutions; m; m &= m - 1) order[n++] = std::countr_zero(m);
+      auto key = [&](uint8_t v) { return std::pair(colors[v], signatures[v]); };
+      std::sort(order, order + n, [&](uint8_t a, uint8_t b) { return key(a) < key(b); });
+      int new_class_count = 0;
+      uint8_t new_colors[64];
+      for (int i = 0; i < n; ++i) {
+        if (i == 0 || key(order[i - 1]) != key(order[i])) {
+          ++new_class_count;
+          new_colors[order[i]] = i;
+        } else {
+          new_colors[order[i]] = new_colors[order[i - 1]];
+        }
+      }
+      for (int i = 0; i < n; ++i) colors[order[i]] = new_colors[order[i]];
+      if (new_class_count == class_count) return;
+      class_count = new_class_count;
+    }
+  }
+
+  void Search(uint8_t colors[64]) {
+    if (leaves > max_leaves) return;
+    Refine(colors);
+
+    // Find the first color class with more than one solution.
+    int class_sizes[64] = {};
+    for (mask_t m = solutions; m; m &= m - 1) ++class_sizes[colors[std::countr_zero(m)]];
+    int target = 0;
+    while (target < 64 && class_sizes[target] < 2) ++target;
+
+    if (target == 64) {
+      // All solutions have distinct colors, which define their order.
+      ++leaves;
+      mask_t relabeled[max_moves];
+      for (size_t i = 0; i < subsets.size(); ++i) {
+        mask_t r = 0;
+        for (mask_t m = subsets[i]; m; m &= m - 1) r |= mask_t{1} << colors[std::countr_zero(m)];
+        relabeled[i] = r;
+      }
+      std::sort(relabeled, relabeled + subsets.size());
+      if (leaves == 1 || std::lexicographical_compare(
+            relabeled, relabeled + subsets.size(), best, best + subsets.size())) {
+        std::copy(relabeled, relabeled + subsets.size(), best);
+      }
+      return;
     }
+
+    // Try individualizing each solution in the target class.
+    for (mask_t m = solutions; m; m &= m - 1) {
+      int v = std::countr_zero(m);
+      if (colors[v] != target) continue;
+      uint8_t child_colors[64];
+      for (mask_t rest = solutions; rest; rest &= rest - 1) {
+        int w = std::countr_zero(rest);
+        child_colors[w] = colors[w] + (colors[w] == target && w != v);
+      }
+      Search(child_colors);
+    }
+  }
+
+  mask_t solutions;
+  std::span<const mask_t> subsets;
+  int leaves = 0;
+  mask_t best[max_moves];
+};
+
+bool IsWinningSmall(
+    AnalysisContext &context,
+    const SmallSolutionSet &set,
+    SmallSolutionSet::mask_t solutions,
+    std::span<const position_t> old_choice_positions,
+    int64_t &work_left,
+    Deadline *deadline,
+    int depth);
+
+// Searches the moves of a small solution set after a memo miss. This is the
+// second half of IsWinningSmall(), which is split off so that IsWinning() can
+// switch to the small kernel after its own memo lookup.
+bool SearchSmall(
+    AnalysisContext &context,
+    const SmallSolutionSet &set,
+    SmallSolutionSet::mask_t solutions,
+    std::span<const position_t> old_choice_positions,
+    memo_key_t key,
+    memo_t::Value &mem,
+    Stats *stats,
+    int64_t &work_left,
+    Deadline *deadline,
+    int depth) {
+  const int solution_count = std::popcount(solutions);
+
+  // Calculate new choice positions and detect immediately winning moves, like
+  // IsWinning() does.
+  int solution_counts[81][9];
+  position_t choice_positions_data[81];
+  size_t choice_positions_size = 0;
+  for (position_t pos : old_choice_positions) {
+    bool inferred = false;
     for (int digit = 1; digit <= 9; ++digit) {
-      int n = solution_count[digit - 1];
-      if (n > 0) {
-        assert((size_t) n < solutions.size());
-        moves.push_back(RankedMove{
-              .move = Move{.pos = pos, .digit = digit},
-              .solution_count = n,
-            });
+      int count = std::popcount(solutions & set.masks[pos][digit]);
+      solution_counts[pos][digit - 1] = count;
+      if (count == solution_count) inferred = true;
+    }
+    if (!inferred) {
+      for (int c : solution_counts[pos]) if (c == 1) {
+        // Immediately winning!
+        counters.immediately_won.Inc();
+        mem.SetWinning(true);
+        if (stats) stats->winning_solutions.Add(solution_count);
+        return true;
       }
+      choice_positions_data[choice_positions_size++] = pos;
     }
   }
-  std::stable_sort(moves.begin(), moves.end());
-  return moves;
+
+  // Generate moves, skipping moves that select the same subset as an earlier
+  // move, like IsWinning() does.
+  RankedMove moves_data[max_moves];
+  size_t moves_size = 0;
+  {
+    DuplicateMoveFilter filter(9 * choice_positions_size);
+    size_t kept_positions_size = 0;
+    for (size_t i = 0; i < choice_positions_size; ++i) {
+      const position_t pos = choice_positions_data[i];
+      bool kept = false;
+      for (int digit = 1; digit <= 9; ++digit) {
+        int count = solution_counts[pos][digit - 1];
+        if (count > 0 && filter.Insert(solutions & set.masks[pos][digit])) {
+          moves_data[moves_size++] = RankedMove{
+            .move = Move{.pos = pos, .digit = digit},
+            .solution_count = count,
+          };
+          kept = true;
+        }
+      }
+      if (kept) choice_positions_data[kept_positions_size++] = pos;
+    }
+    choice_positions_size = kept_positions_size;
+  }
+
+  std::span<position_t> choice_positions(choice_positions_data, choice_positions_size);
+
+  // Check memo for the canonical key (see CanonicalKey above).
+  std::optional<memo_key_t> canonical_key;
+  if (solution_count <= context.canonical_memo_max_size) {
+    SmallSolutionSet::mask_t subsets[max_moves];
+    size_t subsets_size = 0;
+    for (size_t i = 0; i < moves_size; ++i) {
+      const Move &move = moves_data[i].move;
+      subsets[subsets_size++] = solutions & set.masks[move.pos][move.digit];
+    }
+    std::sort(subsets, subsets + subsets_size);
+    subsets_size = std::unique(subsets, subsets + subsets_size) - subsets;
+    canonical_key = CanonicalKey(solutions, std::span(subsets, subsets_size)).Calculate();
+    if (canonical_key) {
+      counters.canonical_accessed.Inc();
+      auto canonical_mem = context.memo.Lookup(*canonical_key);
+      if (canonical_mem.HasValue()) {
+        counters.canonical_returned.Inc();
+        mem.SetWinning(canonical_mem.GetWinning());
+        return canonical_mem.GetWinning();
+      }
+    }
+  }
+
+  if (stats) {
+    stats->solutions.Add(solution_count);
+    stats->positions.Add(choice_positions_size);
+    stats->moves.Add(moves_size);
+  }
+
+  bool winning = false;
+  std::span<RankedMove> moves(moves_data, moves_size);
+  ApplyMoveHint(moves, mem.GetHint());
+  for (const auto [move, count] : SortingIterable(moves)) {
+    counters.max_depth.Inc();
+    bool next_losing = !IsWinningSmall(
+        context, set,
+        solutions & set.masks[move.pos][move.digit],
+        FilterPositions(choice_positions, move.pos),
+        work_left, deadline, depth + 1);
+    counters.max_depth.Dec();
+    if (work_left < 0) {
+      // Search aborted.
+      mem.SetHint(MoveHint(move));
+      return false;
+    }
+    if (next_losing) {
+      winning = true;
+      if (count == 0) counters.hint_cutoff.Inc();
+      if (depth <= StrategyCache::max_depth) context.strategy_cache.Add(key, move);
+      mem.SetWinning(true);
+      break;
+    }
+  }
+  if (!winning) mem.SetWinning(false);
+  if (canonical_key) context.memo.Lookup(*canonical_key).SetWinning(winning);
+  return winning;
+}
+
+// Same as IsWinning() below, for a subset of a small solution set.
+bool IsWinningSmall(
+    AnalysisContext &context,
+    const SmallSolutionSet &set,
+    SmallSolutionSet::mask_t solutions,
+    std::span<const position_t> old_choice_positions,
+    int64_t &work_left,
+    Deadline *deadline,
+    int depth) {
+  const int solution_count = std::popcount(solutions);
+  assert(solution_count > 1);
+  assert(!old_choice_positions.empty());
+
+  // Update counters.
+  counters.recursive_calls.Inc();
+  counters.total_solutions.Add(solution_count);
+
+  Stats *stats = nullptr;
+  if (collect_stats) [[unlikely]] {
+    stats = &LocalStats();
+    if (depth < Stats::max_depth) stats->nodes_by_depth[depth].Add(1);
+  }
+
+  work_left -= solution_count;
+  if (work_left < 0) return false;  // Search aborted.
+  if (deadline && deadline->Poll(solution_count)) {
+    work_left = -1;  // Search aborted.
+    return false;
+  }
+
+  // Check memo for cached result.
+  counters.memo_accessed.Inc();
+  memo_key_t key = set.Hash(solutions);
+  auto mem = context.memo.Lookup(key);
+  if (mem.HasValue()) {
+    counters.memo_returned.Inc();
+    if (stats && depth < Stats::max_depth) stats->memo_hits_by_depth[depth].Add(1);
+    return mem.GetWinning();
+  }
+
+  return SearchSmall(context, set, solutions, old_choice_positions,
+      key, mem, stats, work_left, deadline, depth);
 }
 
+// Digit counts and subset hashes calculated by IsWinning() for the parent of
+// a position, from which the counts of the position can be derived.
+struct ParentCounts {
+  const int (&solution_counts)[81][9];
+  const memo_key_t (&subset_hashes)[81][9];
+
+  // Solutions of the parent that were removed by the move.
+  std::span<const HashedSolution> removed;
+
+  // Hash of the remaining solutions (which is the memo key of the child).
+  memo_key_t key;
+};
+
 // This function determines if the given state is winning for the next player.
+//
+// `depth` is the number of moves played since the root of the search (minus 1),
+// which is only used for statistics.
+//
+// If `parent` is given, digit counts are derived from the parent's counts
+// when fewer solutions were removed than remain, so the cost of counting
+// scales with the smaller side of each split.
 bool IsWinning(
+    AnalysisContext &context,
     std::span<HashedSolution> solutions,
     std::span<const position_t> old_choice_positions,
-    int64_t &work_left) {
+    int64_t &work_left,
+    Deadline *deadline,
+    int depth,
+    const ParentCounts *parent = nullptr) {
   assert(solutions.size() > 1);
   assert(!old_choice_positions.empty());
 
@@ -254,18 +523,37 @@ bool IsWinning(
   counters.recursive_calls.Inc();
   counters.total_solutions.Add(solutions.size());
 
+  Stats *stats = nullptr;
+  if (collect_stats) [[unlikely]] {
+    stats = &LocalStats();
+    if (depth < Stats::max_depth) stats->nodes_by_depth[depth].Add(1);
+  }
+
   work_left -= solutions.size();
   if (work_left < 0) return false;  // Search aborted.
+  if (deadline && deadline->Poll(solutions.size())) {
+    work_left = -1;  // Search aborted.
+    return false;
+  }
 
   // Check memo for cached result.
   counters.memo_accessed.Inc();
-  memo_key_t key = HashSolutionSet(solutions);
-  auto mem = memo.Lookup(key);
+  memo_key_t key = parent ? parent->key : HashSolutionSet(solutions);
+  assert(key == HashSolutionSet(solutions));
+  auto mem = context.memo.Lookup(key);
   if (mem.HasValue()) {
     counters.memo_returned.Inc();
+    if (stats && depth < Stats::max_depth) stats->memo_hits_by_depth[depth].Add(1);
     return mem.GetWinning();
   }
 
+  if (solutions.size() <= SmallSolutionSet::max_size) {
+    SmallSolutionSet set(solutions, old_choice_positions);
+    return SearchSmall(context, set,
+        SmallSolutionSet::AllMask(solutions.size()), old_choice_positions,
+        key, mem, stats, work_left, deadline, depth);
+  }
+
   // Calculate new choice positions and detect immediately winning moves.
   //
   // For each choice position:
@@ -274,15 +562,39 @@ bool IsWinning(
   //     is an inferred digit and we omit it from the new choice positions.
   //  2. Check if there is a digit that occurs in exactly 1 solution. If so,
   //     then this is an immediately winning move.
-  int solution_counts[81][9] = {};
+  //
+  // Also calculates the hash of the subset of solutions selected by each move,
+  // which is used to skip duplicate moves below.
+  //
+  // The parent's counts are complete for all of our old choice positions, so
+  // when fewer solutions were removed than remain, it is cheaper to subtract
+  // the removed solutions from them than to count the remaining ones.
+  const bool derive_counts = parent && parent->removed.size() < solutions.size();
+  int solution_counts[81][9];
+  memo_key_t subset_hashes[81][9];
   position_t choice_positions_data[81];
   size_t choice_positions_size = 0;
   for (position_t pos : old_choice_positions) {
     bool inferred = false;
-    for (const auto &entry : solutions) {
-      if (++solution_counts[pos][entry.solution[pos] - 1] == (int) solutions.size()) {
-        inferred = true;
-        break;
+    if (derive_counts) {
+      std::copy(std::begin(parent->solution_counts[pos]), std::end(parent->solution_counts[pos]),
+          solution_counts[pos]);
+      std::copy(std::begin(parent->subset_hashes[pos]), std::end(parent->subset_hashes[pos]),
+          subset_hashes[pos]);
+      for (const auto &entry : parent->removed) {
+        subset_hashes[pos][entry.solution[pos] - 1] ^= entry.hash;
+        --solution_counts[pos][entry.solution[pos] - 1];
+      }
+      for (int c : solution_counts[pos]) inferred |= c == (int) solutions.size();
+    } else {
+      std::fill(std::begin(solution_counts[pos]), std::end(solution_counts[pos]), 0);
+      std::fill(std::begin(subset_hashes[pos]), std::end(subset_hashes[pos]), 0);
+      for (const auto &entry : solutions) {
+        subset_hashes[pos][entry.solution[pos] - 1] ^= entry.hash;
+        if (++solution_counts[pos][entry.solution[pos] - 1] == (int) solutions.size()) {
+          inferred = true;
+          break;
+        }
       }
     }
     if (!inferred) {
@@ -290,56 +602,177 @@ bool IsWinning(
         // Immediately winning!
         counters.immediately_won.Inc();
         mem.SetWinning(true);
-#if COLLECT_STATS
-        stats_winning_solutions.push_back(solutions.size());
-#endif
+        if (stats) stats->winning_solutions.Add(solutions.size());
         return true;
       }
       choice_positions_data[choice_positions_size++] = pos;
     }
   }
 
-  std::span<position_t> choice_positions(choice_positions_data, choice_positions_size);
-
+  // Generate moves. A move that selects the same subset of solutions as an
+  // earlier move leads to the same position, so it is skipped. A position
+  // whose moves are all skipped is dropped from the choice positions too: in
+  // every descendant, each of its moves still selects the same subset as a
+  // move on one of the remaining positions.
   RankedMove moves_data[max_moves];
   size_t moves_size = 0;
-  for (position_t pos : choice_positions) {
-    for (int digit = 1; digit <= 9; ++digit) {
-      int solution_count = solution_counts[pos][digit - 1];
-      if (solution_count > 0) {
-        moves_data[moves_size++] = RankedMove{
-          .move = Move{.pos = pos, .digit = digit},
-          .solution_count = solution_count,
-        };
+  {
+    DuplicateMoveFilter filter(9 * choice_positions_size);
+    size_t kept_positions_size = 0;
+    for (size_t i = 0; i < choice_positions_size; ++i) {
+      const position_t pos = choice_positions_data[i];
+      bool kept = false;
+      for (int digit = 1; digit <= 9; ++digit) {
+        int solution_count = solution_counts[pos][digit - 1];
+        if (solution_count > 0 && filter.Insert(subset_hashes[pos][digit - 1])) {
+          moves_data[moves_size++] = RankedMove{
+            .move = Move{.pos = pos, .digit = digit},
+            .solution_count = solution_count,
+          };
+          kept = true;
+        }
       }
+      if (kept) choice_positions_data[kept_positions_size++] = pos;
     }
+    choice_positions_size = kept_positions_size;
   }
 
-#if COLLECT_STATS
-  stats_solutions.push_back(solutions.size());
-  stats_positions.push_back(choice_positions_size);
-  stats_moves.push_back(moves_size);
-#endif
+  std::span<position_t> choice_positions(choice_positions_data, choice_positions_size);
+
+  if (stats) {
+    stats->solutions.Add(solutions.size());
+    stats->positions.Add(choice_positions_size);
+    stats->moves.Add(moves_size);
+  }
 
   // Solve recursively. We consider all possible moves: if there is a move
   // that leads to a position that is losing for the opponent, then that
   // move is winning for the current player.
+  //
+  // If the memo has a hint for this position, the hinted move is tried first.
   bool winning = false;
   std::span<RankedMove> moves(moves_data, moves_size);
+  ApplyMoveHint(moves, mem.GetHint());
   for (const auto [move, solution_count] : SortingIterable(moves)) {
+    std::span<HashedSolution> remaining_solutions = FilterSolutions(solutions, move);
+    const ParentCounts parent_counts = {
+      .solution_counts = solution_counts,
+      .subset_hashes = subset_hashes,
+      .removed = solutions.subspan(remaining_solutions.size()),
+      .key = subset_hashes[move.pos][move.digit - 1],
+    };
     counters.max_depth.Inc();
     bool next_losing = !IsWinning(
-        FilterSolutions(solutions, move),
+        context,
+        remaining_solutions,
         FilterPositions(choice_positions, move.pos),
-        work_left);
+        work_left, deadline, depth + 1, &parent_counts);
     counters.max_depth.Dec();
-    if (work_left < 0) return false;  // Search aborted.
-    if (next_losing) { winning = true; break; }
+    if (work_left < 0) {
+      // Search aborted.
+      mem.SetHint(MoveHint(move));
+      return false;
+    }
+    if (next_losing) {
+      winning = true;
+      if (solution_count == 0) counters.hint_cutoff.Inc();
+      if (depth <= StrategyCache::max_depth) context.strategy_cache.Add(key, move);
+      mem.SetWinning(true);
+      break;
+    }
   }
-  mem.SetWinning(winning);
+  if (!winning) mem.SetWinning(false);
   return winning;
 }
 
+// Returns whether any move selects exactly 1 of the given solutions.
+bool HasImmediatelyWinningMove(
+    std::span<const HashedSolution> solutions,
+    std::span<const position_t> choice_positions) {
+  for (position_t pos : choice_positions) {
+    int solution_counts[9] = {};
+    for (const auto &entry : solutions) ++solution_counts[entry.solution[pos] - 1];
+    for (int c : solution_counts) if (c == 1) return true;
+  }
+  return false;
+}
+
+// Returns the estimated work of the search below a single random path from
+// the given position (see EstimateAnalysisWork()). Reorders the solutions.
+double ProbeAnalysisWork(
+    memo_t &memo,
+    std::span<HashedSolution> solutions,
+    std::span<position_t> choice_positions,
+    rng_t &rng) {
+  double estimate = 0;
+  double weight = 1;
+  for (int depth = 0;; ++depth) {
+    // This node costs as much work as IsWinning() charges for it.
+    estimate += weight * solutions.size();
+    if (depth > 0 && memo.Lookup(HashSolutionSet(solutions)).HasValue()) return estimate;
+
+    // Generate moves like IsWinning() does, stopping at immediately winning
+    // positions, which are leaves of the search tree.
+    RankedMove moves[max_moves];
+    size_t moves_size = 0;
+    size_t kept_positions_size = 0;
+    DuplicateMoveFilter filter(9 * choice_positions.size());
+    for (position_t pos : choice_positions) {
+      int solution_counts[9] = {};
+      memo_key_t subset_hashes[9] = {};
+      for (const auto &entry : solutions) {
+        subset_hashes[entry.solution[pos] - 1] ^= entry.hash;
+        ++solution_counts[entry.solution[pos] - 1];
+      }
+      bool inferred = false;
+      for (int c : solution_counts) {
+        if (c == 1) return estimate;  // immediately winning
+        if (c == (int) solutions.size()) inferred = true;
+      }
+      if (inferred) continue;
+      bool kept = false;
+      for (int digit = 1; digit <= 9; ++digit) {
+        int n = solution_counts[digit - 1];
+        if (n > 0 && filter.Insert(subset_hashes[digit - 1])) {
+          moves[moves_size++] = RankedMove{.move = Move{.pos = pos, .digit = digit}, .solution_count = n};
+          kept = true;
+        }
+      }
+      if (kept) choice_positions[kept_positions_size++] = pos;
+    }
+    assert(moves_size > 0);
+    choice_positions = choice_positions.first(kept_positions_size);
+
+    // Model the search tree as a proof tree: at even depths (where the player
+    // to move at the root is to move), the search stops at the first winning
+    // move, while at odd depths, all moves must be refuted. So at even depths,
+    // the probe follows the first move in IsWinning()'s order that is not
+    // refuted cheaply (by an immediately winning reply, or by the memo), and
+    // at odd depths, it follows a random move with a weight equal to the
+    // number of moves (Knuth's estimator).
+    const RankedMove *next = nullptr;
+    if (depth % 2 == 0) {
+      std::sort(moves, moves + moves_size);
+      for (size_t i = 0; i < moves_size && !next; ++i) {
+        std::span<const HashedSolution> child = FilterSolutions(solutions, moves[i].move);
+        auto mem = memo.Lookup(HashSolutionSet(child));
+        if (mem.HasValue() ? mem.GetWinning() : HasImmediatelyWinningMove(child, choice_positions)) {
+          estimate += weight * child.size();
+        } else {
+          next = &moves[i];
+        }
+      }
+      if (!next) return estimate;  // all moves lose
+    } else {
+      next = &moves[std::uniform_int_distribution<size_t>(0, moves_size - 1)(rng)];
+      weight *= moves_size;
+    }
+    const Move move = next->move;
+    solutions = FilterSolutions(solutions, move);
+    choice_positions = FilterPositions(choice_positions, move.pos);
+  }
+}
+
 std::vector<Turn> Turns(std::span<const Move> moves, bool claim_unique=false) {
   std::vector<Turn> result;
   result.reserve(moves.size());
@@ -355,11 +788,13 @@ std::vector<Turn> Turns(std::span<const Move> moves, bool claim_unique=false) {
 // This is very similar to IsWinning2() except this also returns an optimal
 // move to play.
 AnalyzeResult SelectMoveFromSolutions2(
+    AnalysisContext &context,
     std::span<HashedSolution> solutions,
     std::vector<position_t> &choice_positions,
     const std::vector<RankedMove> &ranked_moves,
     int max_winning_turns,
-    int64_t work_left) {
+    int64_t &work_left,
+    Deadline *deadline) {
   assert(solutions.size() > 1);
 
   // Recursively search for a winning move.
@@ -375,9 +810,21 @@ AnalyzeResult SelectMoveFromSolutions2(
     // We should have found immediately-winning moves already before.
     assert(remaining_solutions.size() == (size_t) solution_count &&
         solution_count > 1 && (size_t) solution_count < solutions.size());
+    const int64_t trace_start = TraceEnabled() ? TraceNow() : 0;
+    const int64_t work_before = work_left;
     counters.max_depth.Inc();
-    bool winning = IsWinning(remaining_solutions, remaining_choice_positions, work_left);
+    bool winning = IsWinning(context, remaining_solutions,
+        remaining_choice_positions, work_left, deadline, 0);
     counters.max_depth.Dec();
+    if (TraceEnabled()) {
+      // One event per top-level move, which shows how the work (and memo
+      // probes) are distributed over the moves considered.
+      std::ostringstream args;
+      args << "\"move\":\"" << move << "\",\"solutions\":" << solution_count
+          << ",\"work\":" << work_before - work_left
+          << ",\"winning\":" << (work_left < 0 ? "null" : winning ? "true" : "false");
+      TraceComplete("move", trace_start, args.str());
+    }
     if (work_left < 0) return AnalyzeResult{};  // Search aborted.
     if (winning) {
       // Winning for the next player => losing for the previous player.
@@ -441,19 +888,24 @@ std::ostream &operator<<(std::ostream &os, const AnalyzeResult &result) {
 }
 
 AnalyzeResult Analyze(
+    AnalysisContext &context,
     const grid_t &givens, std::span<const solution_t> solutions,
-    int max_winning_turns, int64_t max_work) {
+    int max_winning_turns, int64_t max_work, Deadline *deadline) {
   assert(!solutions.empty());
   assert(max_winning_turns > 0);
 
   if (solutions.size() == 1) {
     // Solution is already unique.
-    return AnalyzeResult{Outcome::WIN1, {Turn(true)}};
+    return AnalyzeResult{Outcome::WIN1, {Turn(true)}, 1};
   }
 
+  TraceScope trace("Analyze");
+  trace.Arg("solutions", solutions.size()).Arg("max_work", max_work);
+
   counters.recursive_calls.Inc();
   counters.total_solutions.Add(solutions.size());
 
+  std::optional<TraceScope> trace_prepare(std::in_place, "prepare");
   candidates_t candidates = CalculateCandidates(solutions);
   std::vector<position_t> choice_positions;
   for (int i = 0; i < 81; ++i) {
@@ -472,6 +924,7 @@ AnalyzeResult Analyze(
 
   std::vector<RankedMove> ranked_moves = GenerateRankedMoves(hashed_solutions, choice_positions);
   assert(!ranked_moves.empty());
+  trace_prepare.reset();
 
   // If there is an immediately winning move, always take it!
   if (ranked_moves.front().solution_count == 1) {
@@ -480,22 +933,67 @@ AnalyzeResult Analyze(
       if (solution_count != 1) break;
       immediately_winning.push_back(move);
     }
-    return AnalyzeResult{Outcome::WIN1, Turns(immediately_winning, true)};
+    return AnalyzeResult{Outcome::WIN1, Turns(immediately_winning, true),
+        (int64_t) solutions.size()};
+  }
+
+  // If a winning move was found by an earlier search, play it.
+  if (max_winning_turns == 1) {
+    if (auto move = context.strategy_cache.Lookup(HashSolutionSet(hashed_solutions))) {
+      trace.Arg("cached", 1);
+      return AnalyzeResult{
+          .outcome = Outcome::WIN2, .optimal_turns = {Turn(*move)},
+          .work = (int64_t) solutions.size(), .cached = true};
+    }
   }
 
   // Otherwise, recursively search for a winning move.
+  int64_t work_left = max_work - solutions.size();
   auto res = SelectMoveFromSolutions2(
-      hashed_solutions, choice_positions, ranked_moves, max_winning_turns,
-      max_work - solutions.size());
+      context, hashed_solutions, choice_positions,
+      ranked_moves, max_winning_turns, work_left, deadline);
+  res.work = max_work - std::max(work_left, int64_t{0});
+  trace.Arg("work", res.work);
 
   // Note: we could clear the memo before returning to save memory, but keeping
   // it populated will help with future searches especially in the common case
   // where both players fill in an inferred digit, which doesn't change the
   // analysis.
 
-#if COLLECT_STATS
-  DumpStats();
-#endif
-
   return res;
 }
+
+int64_t EstimateAnalysisWork(
+    AnalysisContext &context,
+    const grid_t &givens, std::span<const solution_t> solutions,
+    int probes, rng_t &rng) {
+  assert(!solutions.empty());
+  assert(probes > 0);
+  if (solutions.size() == 1) return 1;
+
+  TraceScope trace("EstimateAnalysisWork");
+  trace.Arg("solutions", solutions.size()).Arg("probes", probes);
+
+  candidates_t candidates = CalculateCandidates(solutions);
+  std::vector<position_t> choice_positions;
+  for (int i = 0; i < 81; ++i) {
+    if (givens[i] == 0 && !Determined(candidates[i])) choice_positions.push_back(i);
+  }
+
+  std::vector<HashedSolution> hashed_solutions;
+  hashed_solutions.reserve(solutions.size());
+  for (const auto &solution : solutions) {
+    hashed_solutions.push_back(HashedSolution{Hash(solution), solution});
+  }
+
+  // Each probe narrows down the choice positions, so it needs its own copy.
+  double total = 0;
+  std::vector<position_t> probe_positions;
+  for (int i = 0; i < probes; ++i) {
+    probe_positions = choice_positions;
+    total += ProbeAnalysisWork(context.memo, hashed_solutions, probe_positions, rng);
+  }
+  int64_t estimate = std::llround(total / probes);
+  trace.Arg("estimate", estimate);
+  return estimate;
+}
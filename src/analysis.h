@@ -1,12 +1,16 @@
 #ifndef ANALYSIS_H_INCLUDED
 #define ANALYSIS_H_INCLUDED
 
+#include "deadline.h"
+#include "memo.h"
 #include "state.h"
 
 #include <array>
 #include <cstdint>
 #include <iostream>
+#include <memory>
 #include <optional>
+#include <span>
 #include <utility>
 #include <vector>
 
@@ -39,19 +43,124 @@ struct AnalyzeResult {
   // List of optimal moves (up to max_winning_moves if the position is
   // winning). Empty if search was aborted.
   std::vector<Turn> optimal_turns;
+
+  // Amount of work performed (in the same unit as max_work).
+  int64_t work = 0;
+
+  // True if the winning move was taken from the strategy cache (see below)
+  // instead of being found by search.
+  bool cached = false;
 };
 
 std::ostream &operator<<(std::ostream &os, const AnalyzeResult &result);
 
+// Winning moves proven during analysis, keyed by the hash of the solution set
+// (the same key that is used for the memo).
+//
+// When Analyze() finds a winning move, the search has also refuted every reply
+// by the opponent. The memo only remembers that those positions are winning
+// for us, so the winning moves found near the root of the search are stored
+// here, which lets Analyze() answer the next turn without searching again, as
+// long as the opponent stays within the proof. Otherwise, the next search
+// extends the proof from the new position.
+//
+// Like LossyMemo, this is a direct-mapped table, where later entries overwrite
+// earlier ones. Since entries are never wrong (only missing), no verification
+// is needed.
+class StrategyCache {
+public:
+  // 2^16 entries of 16 bytes each take 1 MB.
+  static const size_t default_size = 1 << 16;
+
+  // Moves are recorded for positions up to this depth below the root move.
+  // Depth 1 are our replies to the opponent's next move.
+  static const int max_depth = 3;
+
+  // `size` is the number of entries, which must be a power of 2.
+  explicit StrategyCache(size_t size = default_size) : entries(size) {
+    assert(size > 0 && (size & (size - 1)) == 0);
+  }
+
+  void Add(memo_key_t key, const Move &move) {
+    entries[key & (entries.size() - 1)] =
+        Entry{.key = key, .pos = (uint8_t) move.pos, .digit = (uint8_t) move.digit};
+  }
+
+  std::optional<Move> Lookup(memo_key_t key) const {
+    const Entry &entry = entries[key & (entries.size() - 1)];
+    if (entry.digit == 0 || entry.key != key) return {};
+    return Move{.pos = entry.pos, .digit = entry.digit};
+  }
+
+private:
+  struct Entry {
+    memo_key_t key = 0;
+    uint8_t pos = 0;
+    uint8_t digit = 0;  // 0 if the entry is unused
+  };
+
+  std::vector<Entry> entries;
+};
+
+// Maximum value of AnalysisContext::canonical_memo_max_size.
+constexpr int max_canonical_memo_size = 64;
+
+// State that is kept between calls to Analyze(), most importantly the memo.
+//
+// A context must not be used by multiple threads at the same time, but
+// different threads can run analysis concurrently using separate contexts.
+// These may share a single memo (see LossyMemo for why this is safe).
+struct AnalysisContext {
+  explicit AnalysisContext(size_t memo_size = LossyMemo::default_size)
+      : owned_memo(std::make_unique<memo_t>(memo_size)), memo(*owned_memo) {}
+
+  // Uses a memo owned by the caller, which must outlive the context.
+  explicit AnalysisContext(memo_t &shared_memo) : memo(shared_memo) {}
+
+  std::unique_ptr<memo_t> owned_memo;
+  memo_t &memo;
+  StrategyCache strategy_cache;
+
+  // If positive, positions with at most this many solutions are also memoized
+  // under a canonical key, which is shared by all isomorphic positions. Must
+  // not exceed max_canonical_memo_size.
+  int canonical_memo_max_size = 0;
+};
+
 // Given the set of given digits, and a *complete* set of solutions, determines
 // the game status and optimal moves.
 //
 // `max_winning_moves` determines the maximum number of winning moves to find.
-// It should be set to 1 in the player to optimize for speed.
+// It should be set to 1 in the player to optimize for speed. In that case, a
+// winning move is returned from context.strategy_cache if one is known.
+//
+// The search is aborted (as if max_work was exceeded) if `deadline` expires,
+// which is checked regularly during the search.
 //
 // Preconditions: solutions.size() > 0
 AnalyzeResult Analyze(
+    AnalysisContext &context,
+    const grid_t &givens, std::span<const solution_t> solutions,
+    int max_winning_moves, int64_t max_work=1e18, Deadline *deadline=nullptr);
+
+// Estimates the work that Analyze() will perform to determine the outcome,
+// without searching, so that callers can decide whether analysis is likely to
+// complete within their budget. The work of a search can vary by orders of
+// magnitude between positions with the same number of solutions.
+//
+// This follows `probes` random paths from the root to a leaf of the search
+// tree (a memoized or immediately winning position), and extrapolates the
+// work of the tree from the number of moves along each path (Knuth's
+// estimator), assuming that the first move in the search order wins. Since
+// that is often not the case, and transpositions are ignored, the estimate is
+// rough: it tends to be far too low, so callers should scale it by a factor
+// that was measured for their kind of positions. The work of estimating is
+// only a tiny fraction of the work of a search.
+//
+// Preconditions: solutions.size() > 0, probes > 0
+int64_t EstimateAnalysisWork(
+    AnalysisContext &context,
     const grid_t &givens, std::span<const solution_t> solutions,
-    int max_winning_moves, int64_t max_work=1e18);
+    int probes, rng_t &rng);
 
 #endif  // ndef ANALYSIS_H_INCLUDED
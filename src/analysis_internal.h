@@ -0,0 +1,149 @@
+// Internal definitions of analysis.cc, which are shared with microbench.cc
+// so that it can benchmark them. They are not part of the analysis API (see
+// analysis.h).
+
+#ifndef ANALYSIS_INTERNAL_H_INCLUDED
+#define ANALYSIS_INTERNAL_H_INCLUDED
+
+#include "analysis.h"
+#include "memo.h"
+#include "state.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace analysis::internal {
+
+using position_t = int_fast8_t;
+
+struct HashedSolution {
+  memo_key_t hash;
+  solution_t solution;
+};
+
+constexpr uint64_t Fnv1a_64(std::span<const uint8_t> bytes) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (uint8_t byte : bytes) {
+    hash ^= byte;
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+// Memo keys are derived from this hash, and may be stored in shared memos, so
+// changing it requires incrementing LossyMemo::shared_format_version.
+inline memo_key_t Hash(const solution_t &solution) {
+  static_assert(std::is_same<memo_key_t, uint64_t>::value);
+  return Fnv1a_64(solution);
+}
+
+// Note: this is an order-independent hash! All permutations of solutions
+// have the same hash value. That's intentional, since the span of solutions
+// is supposed to model a set of solutions, not an ordered sequence.
+inline memo_key_t HashSolutionSet(std::span<const HashedSolution> solutions) {
+  memo_key_t hash = 0;
+  for (const auto &entry : solutions) hash ^= entry.hash;
+  return hash;
+}
+
+// For each cell, calculates a bitmask of possible digits.
+inline candidates_t CalculateCandidates(std::span<const solution_t> solutions) {
+  candidates_t candidates = {};
+  for (const solution_t &solution : solutions) {
+    for (int i = 0; i < 81; ++i) candidates[i] |= 1u << solution[i];
+  }
+  return candidates;
+}
+
+constexpr bool Determined(unsigned mask) { return (mask & (mask - 1)) == 0; }
+
+// std::span<T> wrapper that allows iteration in sorted order.
+//
+// Construction takes O(N) time, dereferencing an iterator takes O(1) time
+// and incrementing an iterator takes O(log N) time.
+//
+// This is useful in the case where it is unlikely that the entire range
+// is iterated over.
+//
+// Note that the elements of the span are reordered during iteration!
+template<class T> class SortingIterable {
+  struct Iterator {
+    std::span<T>::iterator begin, end;
+
+    T &operator*() { return *begin; }
+
+    Iterator &operator++() {
+      std::pop_heap(begin, end, std::greater<T>());
+      --end;
+      return *this;
+    }
+
+    bool operator==(const Iterator &o) const { return end == o.end; }
+  };
+
+public:
+  explicit SortingIterable(std::span<T> data) : data(data) {};
+
+  Iterator begin() {
+    std::make_heap(data.begin(), data.end(), std::greater<T>());
+    return Iterator{data.begin(), data.end()};
+  }
+
+  Iterator end() {
+    return Iterator{data.begin(), data.begin()};
+  }
+
+private:
+
+  std::span<T> data;
+};
+
+inline std::span<HashedSolution> FilterSolutions(std::span<HashedSolution> solutions, Move move) {
+  return std::span<HashedSolution>(
+    solutions.begin(),
+    std::partition(solutions.begin(), solutions.end(),
+        [move](const auto &s) { return s.solution[move.pos] == move.digit; }));
+}
+
+struct RankedMove {
+  Move move;
+  int solution_count;
+
+  auto operator<=>(const RankedMove &o) const { return solution_count <=> o.solution_count; }
+};
+
+// Generates stably sorted ranked moves, sorted by increasing solution count.
+// This may include immediately winning moves with solution count == 1, which
+// will necessarily appear at the front of the list.
+inline std::vector<RankedMove> GenerateRankedMoves(
+    std::span<HashedSolution> solutions,
+    std::span<const position_t> choice_positions) {
+  std::vector<RankedMove> moves;
+  for (position_t pos : choice_positions) {
+    int solution_count[9] = {};
+    for (const auto &entry : solutions) {
+      ++solution_count[entry.solution[pos] - 1];
+    }
+    for (int digit = 1; digit <= 9; ++digit) {
+      int n = solution_count[digit - 1];
+      if (n > 0) {
+        assert((size_t) n < solutions.size());
+        moves.push_back(RankedMove{
+              .move = Move{.pos = pos, .digit = digit},
+              .solution_count = n,
+            });
+      }
+    }
+  }
+  std::stable_sort(moves.begin(), moves.end());
+  return moves;
+}
+
+}  // namespace analysis::internal
+
+#endif  // ndef ANALYSIS_INTERNAL_H_INCLUDED
@@ -0,0 +1,217 @@
+#include "arena.h"
+
+#include "options.h"
+#include "random.h"
+#include "state.h"
+#include "strategy.h"
+
+#include <cassert>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace {
+
+// Returns whether the grid has at least one solution.
+bool HasSolution(State state) {
+  return state.HasSolution();
+}
+
+template<class T>
+bool ParseInteger(std::string_view s, T &value) {
+  return options::internal::ParseIntegralValue(s, value);
+}
+
+bool ParseParam(std::string_view key, std::string_view value, StrategyParams &params) {
+  if (key == "enumerate-min-clues") return ParseInteger(value, params.enumerate_min_clues);
+  if (key == "enumerate-max-count") return ParseInteger(value, params.enumerate_max_count);
+  if (key == "enumerate-max-work")  return ParseInteger(value, params.enumerate_max_work);
+  if (key == "analyze-max-count")   return ParseInteger(value, params.analyze_max_count);
+  if (key == "marginals-max-work")  return ParseInteger(value, params.marginals_max_work);
+  if (key == "marginals-by-bands") {
+    return options::internal::ParseValue(value, params.marginals_by_bands);
+  }
+  if (key == "analyze-max-work")    return ParseInteger(value, params.analyze_max_work);
+  if (key == "analyze-batch-size")  return ParseInteger(value, params.analyze_batch_size);
+  if (key == "time-limit") {
+    double seconds;
+    if (!options::internal::ParseGenericValue(value, seconds) || seconds < 0) return false;
+    params.time_limit = std::chrono::duration_cast<log_duration_t>(
+        std::chrono::duration<double>(seconds));
+    return true;
+  }
+  if (key == "analyze-estimate-probes") return ParseInteger(value, params.analyze_estimate_probes);
+  if (key == "analyze-estimate-scale") {
+    return options::internal::ParseGenericValue(value, params.analyze_estimate_scale) &&
+        params.analyze_estimate_scale > 0;
+  }
+  if (key == "analyze-work-rate")   return ParseInteger(value, params.analyze_work_rate);
+  if (key == "canonical-memo-max-size") {
+    return ParseInteger(value, params.canonical_memo_max_size) &&
+        params.canonical_memo_max_size >= 0 &&
+        params.canonical_memo_max_size <= max_canonical_memo_size;
+  }
+  if (key == "analyze-time-fraction") {
+    return options::internal::ParseGenericValue(value, params.analyze_time_fraction) &&
+        params.analyze_time_fraction > 0 && params.analyze_time_fraction <= 1;
+  }
+  if (key == "memo-size") {
+    return ParseInteger(value, params.memo_size) &&
+        params.memo_size > 0 && (params.memo_size & (params.memo_size - 1)) == 0;
+  }
+  return false;
+}
+
+bool ApplyPreset(std::string_view preset, StrategyParams &params) {
+  if (preset == "default") return true;
+  if (preset == "heuristic") {
+    // Analysis with a single solution just claims the win.
+    params.analyze_max_count = 1;
+    return true;
+  }
+  if (preset == "random") {
+    params.enumerate_min_clues = 82;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+std::ostream &operator<<(std::ostream &os, GameOutcome outcome) {
+  switch (outcome) {
+  case GameOutcome::WIN: return os << "WIN";
+  case GameOutcome::LOSS: return os << "LOSS";
+  case GameOutcome::UNSOLVABLE: return os << "UNSOLVABLE";
+  case GameOutcome::NONREDUCE: return os << "NONREDUCE";
+  case GameOutcome::FAIL: return os << "FAIL";
+  default:
+    assert(false);
+    return os;
+  }
+}
+
+bool IsReducing(const State &state, const Move &move) {
+  for (int digit = 1; digit <= 9; ++digit) {
+    if (digit == move.digit) continue;
+    Move other = {.pos = move.pos, .digit = digit};
+    if (!state.CanPlay(other)) continue;
+    State next = state;
+    next.Play(other);
+    if (HasSolution(next)) return true;
+  }
+  return false;
+}
+
+std::optional<PlayerConfig> ParsePlayerConfig(
+    std::string_view spec, const StrategyParams &base) {
+  PlayerConfig config = {.name = std::string(spec), .params = base};
+  size_t pos = spec.find(',');
+  if (!ApplyPreset(spec.substr(0, pos), config.params)) return {};
+  while (pos != std::string_view::npos) {
+    size_t start = pos + 1;
+    pos = spec.find(',', start);
+    std::string_view item = spec.substr(start, pos == std::string_view::npos ? pos : pos - start);
+    size_t sep = item.find('=');
+    if (sep == std::string_view::npos ||
+        !ParseParam(item.substr(0, sep), item.substr(sep + 1), config.params)) {
+      return {};
+    }
+  }
+  return config;
+}
+
+std::chrono::nanoseconds ThreadCpuTime() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+GameRecord SimulateGame(const PlayerConfig *players[2], const rng_seed_t &seed) {
+  std::optional<rng_t> rngs[2];
+  std::optional<Strategy> strategies[2];
+  for (int i = 0; i < 2; ++i) {
+    rng_seed_t player_seed = seed;
+    player_seed.push_back(i);
+    rngs[i].emplace(CreateRng(player_seed));
+    strategies[i].emplace(players[i]->params);
+  }
+
+  GameRecord record;
+  State state;
+
+  auto Fail = [&record](int player, GameOutcome outcome) {
+    record.outcomes[player] = outcome;
+    record.outcomes[1 - player] = GameOutcome::WIN;
+  };
+
+  for (int turn_index = 0; turn_index < 81; ++turn_index) {
+    const int player = turn_index % 2;
+    Strategy &strategy = *strategies[player];
+
+    auto start_time = ThreadCpuTime();
+    TurnInfo info = strategy.SelectTurn(*rngs[player],
+        std::chrono::duration_cast<log_duration_t>(record.cpu_time[player]));
+    auto cpu_time = ThreadCpuTime() - start_time;
+    record.cpu_time[player] += cpu_time;
+    record.turns.push_back(TurnRecord{
+        .turn = info.turn,
+        .player = player,
+        .solution_count = info.solution_count,
+        .solutions_complete = info.solutions_complete,
+        .cpu_time = cpu_time});
+
+    const Turn &turn = info.turn;
+    if (turn.Empty()) {
+      Fail(player, GameOutcome::FAIL);
+      return record;
+    }
+
+    for (const Move &move : turn.Moves()) {
+      if (!state.IsFree(move.pos)) {
+        Fail(player, GameOutcome::FAIL);
+        return record;
+      }
+      if (!IsReducing(state, move)) {
+        Fail(player, GameOutcome::NONREDUCE);
+        return record;
+      }
+      if (!state.CanPlay(move)) {
+        Fail(player, GameOutcome::UNSOLVABLE);
+        return record;
+      }
+      state.Play(move);
+      if (!HasSolution(state)) {
+        Fail(player, GameOutcome::UNSOLVABLE);
+        return record;
+      }
+      for (auto &s : strategies) s->PlayMove(move);
+    }
+
+    if (turn.claim_unique) {
+      if (state.CountSolutions(2).count == 1) {
+        record.outcomes[player] = GameOutcome::WIN;
+      } else {
+        Fail(player, GameOutcome::FAIL);
+      }
+      return record;
+    }
+  }
+  return record;
+}
+
+void PrintGameRecord(std::ostream &os, const GameRecord &record) {
+  using seconds_t = std::chrono::duration<double>;
+  os << record.outcomes[0] << '\t' << record.outcomes[1] << std::fixed << std::setprecision(3)
+      << '\t' << seconds_t(record.cpu_time[0]).count()
+      << '\t' << seconds_t(record.cpu_time[1]).count() << '\t';
+  for (size_t i = 0; i < record.turns.size(); ++i) {
+    const TurnRecord &t = record.turns[i];
+    if (i > 0) os << ' ';
+    if (t.turn.Empty()) os << '-'; else os << t.turn;
+    os << ':' << std::chrono::duration_cast<std::chrono::microseconds>(t.cpu_time).count();
+  }
+}
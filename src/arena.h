@@ -0,0 +1,101 @@
+// In-process simulation of games between two strategies (see strategy.h).
+//
+// This plays by the same rules as arbiter.py (including its checks for
+// unsolvable and non-reducing moves), but without the overhead of separate
+// processes and pipe I/O, so many games can be played quickly, and in
+// parallel on multiple threads.
+
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+#include "random.h"
+#include "state.h"
+#include "strategy.h"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Outcome of a game for a single player. Same as in arbiter.py.
+enum class GameOutcome {
+  WIN,         // regular win: either claimed win or opponent lost
+  LOSS,        // loss or tie
+  UNSOLVABLE,  // move was valid but made grid unsolvable
+  NONREDUCE,   // move did not reduce solution set
+  FAIL,        // invalid move or incorrect claim
+};
+
+std::ostream &operator<<(std::ostream &os, GameOutcome outcome);
+
+// Returns whether the move reduces the set of solutions, i.e., whether there
+// is a solution with a different digit at the move's position. Same as
+// IsReducing() in arbiter.py.
+bool IsReducing(const State &state, const Move &move);
+
+struct PlayerConfig {
+  std::string name;
+  StrategyParams params;
+};
+
+// Parses a player specification of the form: "<preset>[,<key>=<value>...]"
+//
+// Presets are:
+//
+//  - "default": the same strategy as the player with default options.
+//  - "heuristic": enumerates solutions, but never analyzes (except to claim
+//    a unique solution).
+//  - "random": never enumerates solutions; picks random moves instead.
+//
+// Keys are the same as the corresponding player options: enumerate-min-clues,
+// enumerate-max-count, enumerate-max-work, marginals-max-work,
+// marginals-by-bands, analyze-max-count, analyze-max-work, analyze-batch-size,
+// analyze-estimate-probes, analyze-work-rate, canonical-memo-max-size,
+// time-limit (in seconds), and additionally analyze-time-fraction,
+// analyze-estimate-scale and memo-size.
+//
+// Fields not set by the preset or keys are copied from `base`. The name is set
+// to the spec itself. Returns an empty optional if the spec is invalid.
+std::optional<PlayerConfig> ParsePlayerConfig(
+    std::string_view spec, const StrategyParams &base = {});
+
+// CPU time used by the calling thread so far.
+std::chrono::nanoseconds ThreadCpuTime();
+
+struct TurnRecord {
+  Turn turn;
+
+  // Index of the player that played this turn (0 or 1).
+  int player = 0;
+
+  // Solutions known to the player when selecting the turn.
+  int64_t solution_count = 0;
+  bool solutions_complete = false;
+
+  // CPU time used to select the turn.
+  std::chrono::nanoseconds cpu_time{0};
+};
+
+struct GameRecord {
+  GameOutcome outcomes[2] = {GameOutcome::LOSS, GameOutcome::LOSS};
+  std::chrono::nanoseconds cpu_time[2] = {};
+  std::vector<TurnRecord> turns;
+};
+
+// Simulates a single game between the two given players, where players[0]
+// moves first. Each player gets its own random number generator, which is
+// seeded with `seed` followed by the player index, so replaying a game with
+// the same seed and deterministic limits (i.e., no time limit) gives the same
+// result.
+GameRecord SimulateGame(const PlayerConfig *players[2], const rng_seed_t &seed);
+
+// Prints a game record on a single line, with tab-separated fields: outcome of
+// the first and second player, CPU time of the first and second player (in
+// seconds), and the turns played, separated by spaces, each followed by a colon
+// and the CPU time spent on it in microseconds.
+void PrintGameRecord(std::ostream &os, const GameRecord &record);
+
+#endif  // ndef ARENA_H_INCLUDED
@@ -0,0 +1,216 @@
+#include "bands.h"
+
+#include "state.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Digits used in each of the 9 columns by the bands that have been filled in,
+// packed as 9 bits per column.
+struct ColumnKey {
+  uint64_t lo = 0, hi = 0;
+
+  bool operator==(const ColumnKey &k) const = default;
+};
+
+struct ColumnKeyHash {
+  size_t operator()(const ColumnKey &k) const {
+    uint64_t h = k.lo * 0x9e3779b97f4a7c15u ^ k.hi;
+    return h ^ (h >> 29);
+  }
+};
+
+// Solution counts for the bands that have not been filled in yet. count[j][d]
+// is the number of completions with digit d in the j-th cell of those bands
+// (in decomposition order).
+struct BandCounts {
+  int64_t total = 0;
+  std::vector<std::array<int64_t, 10>> count;
+};
+
+class BandCounter {
+public:
+  BandCounter(const State &state, int64_t max_work, Deadline *deadline)
+      : state(state), work_left(max_work), deadline(deadline) {
+    // Decompose the bands in order of decreasing number of givens, so that the
+    // first band has the fewest completions.
+    int givens[3] = {};
+    for (int i = 0; i < 81; ++i) givens[i / 27] += !state.IsFree(i);
+    std::stable_sort(std::begin(order), std::end(order),
+        [&givens](int a, int b) { return givens[a] > givens[b]; });
+    for (int level = 0; level < 3; ++level) {
+      for (int j = 0; j < 27; ++j) cells[27*level + j] = 27*order[level] + j;
+    }
+  }
+
+  // Returns false if the work limit was reached.
+  bool Count(Marginals &marginals) {
+    BandCounts counts;
+    CountLevel(0, counts);
+    if (work_left == 0) return false;
+    marginals.total = counts.total;
+    for (int j = 0; j < 81; ++j) {
+      std::copy(counts.count[j].begin(), counts.count[j].end(), marginals.count[cells[j]]);
+    }
+    return true;
+  }
+
+  int64_t WorkLeft() const { return work_left; }
+
+private:
+  // Counts the completions of the bands from `level` onward, given that the
+  // bands before `level` have been filled in.
+  void CountLevel(int level, BandCounts &result) {
+    const int cell_count = 81 - 27*level;
+    result.total = 0;
+    result.count.assign(cell_count, {});
+
+    if (level == 2) {
+      // Last band: count directly.
+      Marginals marginals;
+      EnumerateResult er = state.CountMarginals(marginals, work_left, deadline);
+      work_left = er.Accurate() ? work_left - er.work : 0;
+      result.total = marginals.total;
+      for (int j = 0; j < 27; ++j) {
+        std::copy(std::begin(marginals.count[cells[54 + j]]),
+            std::end(marginals.count[cells[54 + j]]), result.count[j].begin());
+      }
+      return;
+    }
+
+    // Enumerate completions of this band, and count how often each completion
+    // of the remaining bands occurs.
+    std::unordered_map<const BandCounts*, int64_t> multiplicity;
+    std::array<int, 27> todo;
+    int todo_size = 0;
+    for (int j = 0; j < 27; ++j) {
+      int i = cells[27*level + j];
+      if (state.IsFree(i)) todo[todo_size++] = i;
+    }
+    FillBand(level, std::span<int>(todo.data(), todo_size), result, multiplicity);
+
+    // Add the counts of the remaining bands, weighted by multiplicity.
+    for (auto [counts, n] : multiplicity) {
+      for (size_t j = 0; j < counts->count.size(); ++j) {
+        for (int d = 1; d <= 9; ++d) {
+          result.count[27 + j][d] += n * counts->count[j][d];
+        }
+      }
+    }
+  }
+
+  // Fills in the cells in `todo` in all possible ways, and for each completed
+  // band, adds the number of completions of the remaining bands to `result`.
+  void FillBand(int level, std::span<int> todo, BandCounts &result,
+      std::unordered_map<const BandCounts*, int64_t> &multiplicity) {
+    if (todo.empty()) {
+      const BandCounts &counts = Lookup(level + 1);
+      if (counts.total == 0 || work_left == 0) return;
+      result.total += counts.total;
+      for (int j = 0; j < 27; ++j) {
+        result.count[j][state.Digit(cells[27*level + j])] += counts.total;
+      }
+      ++multiplicity[&counts];
+      return;
+    }
+
+    if (deadline && deadline->Poll(todo.size())) {
+      work_left = 0;
+      return;
+    }
+
+    // Find most constrained cell to fill in.
+    int min_unused_count = 10;
+    int min_unused_index = -1;
+    unsigned min_unused_mask = 0;
+    for (int j = 0; j < (int) todo.size(); ++j) {
+      unsigned unused = state.CellUnused(todo[j]);
+      if (unused == 0) return;  // unsolvable
+      int unused_count = std::popcount(unused);
+      if (unused_count < min_unused_count) {
+        min_unused_index = j;
+        min_unused_count = unused_count;
+        min_unused_mask = unused;
+      }
+    }
+    std::swap(todo[min_unused_index], todo.back());
+
+    const int i = todo.back();
+    std::span<int> remaining(todo.begin(), todo.end() - 1);
+
+    unsigned unused = min_unused_mask;
+    while (unused && work_left) {
+      --work_left;
+      int d = std::countr_zero(unused);
+      unused ^= 1u << d;
+      Move move = {.pos = i, .digit = d};
+      state.Play(move);
+      FillBand(level, remaining, result, multiplicity);
+      state.Undo(move);
+    }
+  }
+
+  // Returns the counts of the bands from `level` onward, given the digits used
+  // per column in the bands before it.
+  const BandCounts &Lookup(int level) {
+    ColumnKey key;
+    for (int j = 0; j < 27*level; ++j) {
+      int i = cells[j];
+      int bit = 9*Col(i) + state.Digit(i) - 1;
+      if (bit < 64) key.lo |= uint64_t{1} << bit; else key.hi |= uint64_t{1} << (bit - 64);
+    }
+    auto [it, inserted] = memo[level - 1].try_emplace(key);
+    if (inserted) {
+      CountLevel(level, it->second);
+      // Charge one unit of work per counter stored, so that the work limit
+      // also bounds memory use.
+      int64_t size = it->second.count.size() * 10;
+      work_left = std::max<int64_t>(work_left - size, 0);
+      if (work_left == 0) {
+        // Don't keep incomplete counts.
+        memo[level - 1].erase(it);
+        static const BandCounts empty;
+        return empty;
+      }
+    }
+    return it->second;
+  }
+
+  State state;
+  int64_t work_left;
+  Deadline *deadline;
+
+  // Bands in decomposition order, and the cells in that order.
+  int order[3] = {0, 1, 2};
+  int cells[81];
+
+  // Memoized counts for levels 1 and 2.
+  std::unordered_map<ColumnKey, BandCounts, ColumnKeyHash> memo[2];
+};
+
+}  // namespace
+
+EnumerateResult CountMarginalsByBands(
+    const State &state, Marginals &marginals, int64_t max_work,
+    Deadline *deadline) {
+  assert(max_work >= 0);
+  assert(marginals.pair_cells.empty());
+  marginals.total = 0;
+  std::fill(&marginals.count[0][0], &marginals.count[0][0] + 81*10, 0);
+  marginals.pair_count.clear();
+
+  BandCounter counter(state, max_work, deadline);
+  bool success = counter.Count(marginals);
+  return EnumerateResult{
+    .success = success,
+    .work = max_work - counter.WorkLeft(),
+    .max_work = max_work};
+}
@@ -0,0 +1,37 @@
+// Solution counting by band decomposition.
+//
+// The grid is split into three bands of three rows each. Bands only interact
+// through the columns: once one band is filled in, the number of ways to
+// complete the other two depends only on which digits were used in each
+// column (and on the givens, which are fixed). This is the observation behind
+// the Felgenhauer-Jarvis count of all Sudoku grids.
+//
+// CountMarginalsByBands() enumerates the completions of the most constrained
+// band, and for each one looks up the counts of the remaining bands in a memo
+// keyed by the digits used per column. The remaining bands are decomposed the
+// same way, and the last band is counted directly. When many completions of
+// the first band share the same column digits, this is much faster than
+// State::CountMarginals(), which visits every solution.
+
+#ifndef BANDS_H_INCLUDED
+#define BANDS_H_INCLUDED
+
+#include "deadline.h"
+#include "state.h"
+
+#include <cstdint>
+
+// Calculates the same result as State::CountMarginals(), except that pair
+// counts are not supported (marginals.pair_cells must be empty).
+//
+// Work is counted per search node as usual, plus one unit per counter stored
+// in the memo, so memory use is bounded by the work limit. The result is
+// accurate only if the work limit was not reached.
+//
+// If a deadline is given, counting stops when it expires, and the result is
+// reported as if the work limit was reached.
+EnumerateResult CountMarginalsByBands(
+    const State &state, Marginals &marginals, int64_t max_work = 1e18,
+    Deadline *deadline = nullptr);
+
+#endif  // ndef BANDS_H_INCLUDED
@@ -1,6 +1,6 @@
 #include "counters.h"
 
-Counters counters;
+thread_local constinit Counters counters;
 
 std::ostream &operator<<(std::ostream &os, const struct Counters &counters) {
   return os << "Counters{\n"
@@ -11,5 +11,9 @@ std::ostream &operator<<(std::ostream &os, const struct Counters &counters) {
     << "\t" << counters.memo_accessed << ",\n"
     << "\t" << counters.memo_returned << ",\n"
     << "\t" << counters.memo_collisions << ",\n"
+    << "\t" << counters.canonical_accessed << ",\n"
+    << "\t" << counters.canonical_returned << ",\n"
+    << "\t" << counters.hint_tried << ",\n"
+    << "\t" << counters.hint_cutoff << ",\n"
     << "}";
 }
@@ -7,7 +7,7 @@
 
 template <typename T> class DummyCounter {
 public:
-  DummyCounter(const char *) {};
+  constexpr DummyCounter(const char *) {};
   T CurValue() const { return 0; }
   T MaxValue() const { return 0; }
   void Inc() {}
@@ -22,7 +22,7 @@ std::ostream &operator<<(std::ostream &os, const DummyCounter<T> &) {
 
 template <typename T> struct RealCounter {
 public:
-  explicit RealCounter(const char *name) : name(name) {}
+  explicit constexpr RealCounter(const char *name) : name(name) {}
   const char *Name() const { return name; }
   T CurValue() const { return cur_value; }
   T MaxValue() const { return cur_value > max_value ? cur_value : max_value; }
@@ -60,10 +60,16 @@ struct Counters {
   counter_t<int64_t> memo_accessed    = counter_t<int64_t>("memo_accessed");
   counter_t<int64_t> memo_returned    = counter_t<int64_t>("memo_returned");
   counter_t<int64_t> memo_collisions  = counter_t<int64_t>("memo_collisions");
+  counter_t<int64_t> canonical_accessed = counter_t<int64_t>("canonical_accessed");
+  counter_t<int64_t> canonical_returned = counter_t<int64_t>("canonical_returned");
+  counter_t<int64_t> hint_tried       = counter_t<int64_t>("hint_tried");
+  counter_t<int64_t> hint_cutoff      = counter_t<int64_t>("hint_cutoff");
 };
 
 std::ostream &operator<<(std::ostream &os, const struct Counters &counters);
 
-extern Counters counters;
+// Counters are thread-local, so that threads that analyze concurrently (each
+// with their own AnalysisContext) don't interfere with each other.
+extern thread_local constinit Counters counters;
 
 #endif  // ndef COUNTERS_H_INCLUDED
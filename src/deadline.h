@@ -0,0 +1,52 @@
+#ifndef DEADLINE_H_INCLUDED
+#define DEADLINE_H_INCLUDED
+
+#include <chrono>
+#include <cstdint>
+
+// A deadline for long-running searches.
+//
+// Searches call Poll() with the approximate cost of each step. This only
+// reads the clock once every `poll_interval` units of cost, so it is cheap
+// enough to call from the innermost loop, while still stopping the search
+// within a few dozen microseconds of the deadline.
+class Deadline {
+public:
+  using clock = std::chrono::steady_clock;
+
+  static constexpr int64_t poll_interval = 1 << 14;
+
+  // Creates a deadline that never expires.
+  Deadline() = default;
+
+  explicit Deadline(clock::time_point time) : time(time) {}
+
+  Deadline(const Deadline &) = delete;
+  Deadline &operator=(const Deadline &) = delete;
+
+  // Sets a new expiration time.
+  void Reset(clock::time_point new_time = clock::time_point::max()) {
+    time = new_time;
+    countdown = 0;
+  }
+
+  bool Expired() const {
+    return time != clock::time_point::max() && clock::now() >= time;
+  }
+
+  // Returns true if the deadline has passed, checking only once per
+  // `poll_interval` units of cost. Once this returns true, it keeps doing so.
+  bool Poll(int64_t cost = 1) {
+    countdown -= cost;
+    if (countdown > 0) [[likely]] return false;
+    if (Expired()) return true;
+    countdown = poll_interval;
+    return false;
+  }
+
+private:
+  clock::time_point time = clock::time_point::max();
+  int64_t countdown = 0;
+};
+
+#endif  // ndef DEADLINE_H_INCLUDED
@@ -0,0 +1,168 @@
+// Generates test cases by random play, like generate-random-grids.py.
+//
+// Each case is generated by playing random moves (in a random order of all
+// cell/digit pairs), skipping moves that make the grid unsolvable and, with
+// --must-reduce, placing but not recording moves that do not reduce the
+// solution set, until the solution is unique. Then the recorded moves are
+// rolled back to the last state with at most --max-solutions solutions.
+//
+// Case i is generated with an RNG seeded with --seed followed by i, so the
+// output does not depend on the number of threads. Output has the same format
+// as data/random-play-until-*-cases.txt: the case number, the number of given
+// digits, and the grid.
+//
+// Example:
+//
+//   generate --cases=10000 --max-solutions=2000 > output/random-play-until-2k-cases.txt
+
+#include "logging.h"
+#include "options.h"
+#include "random.h"
+#include "state.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+DECLARE_OPTION(bool, arg_help, false, "help",
+    "show usage information");
+
+DECLARE_OPTION(int64_t, arg_cases, 1000, "cases",
+    "Number of cases to generate.");
+
+DECLARE_OPTION(int64_t, arg_max_solutions, 2000, "max-solutions",
+    "Maximum number of solutions of each case.");
+
+DECLARE_OPTION(bool, arg_must_reduce, true, "must-reduce",
+    "Only record moves that reduce the solution set (like MUST_REDUCE in "
+    "generate-random-grids.py).");
+
+DECLARE_OPTION(int, arg_jobs, std::max(1u, std::thread::hardware_concurrency()), "jobs",
+    "Number of threads used to generate cases.");
+
+DECLARE_OPTION(std::string, arg_seed, "", "seed",
+    "Random seed in hexadecimal format. If empty, pick randomly. Case i is "
+    "generated with the seed followed by i.");
+
+bool IsSolvableMove(const State &state, const Move &move) {
+  if (!state.CanPlay(move)) return false;
+  State next = state;
+  next.Play(move);
+  return next.HasSolution();
+}
+
+// Generates a single case, and returns it formatted as an output line.
+std::string GenerateCase(int64_t case_index, const rng_seed_t &seed) {
+  rng_seed_t case_seed = seed;
+  case_seed.push_back(case_index);
+  rng_t rng = CreateRng(case_seed);
+
+  std::vector<Move> moves;
+  for (int pos = 0; pos < 81; ++pos) {
+    for (int digit = 1; digit <= 9; ++digit) moves.push_back(Move{.pos = pos, .digit = digit});
+  }
+  std::shuffle(moves.begin(), moves.end(), rng);
+
+  // Play random moves until the solution is unique. `state` contains all
+  // placed digits, while `history` contains only the recorded moves.
+  State state;
+  std::vector<Move> history;
+  for (const Move &move : moves) {
+    if (!state.IsFree(move.pos) || !IsSolvableMove(state, move)) continue;
+    bool other_solvable = !arg_must_reduce;
+    for (int digit = 1; digit <= 9 && !other_solvable; ++digit) {
+      if (digit != move.digit) {
+        other_solvable = IsSolvableMove(state, Move{.pos = move.pos, .digit = digit});
+      }
+    }
+    // If no other digit is possible, the digit is still placed, because it is
+    // determined uniquely, and doing so speeds up later checks.
+    state.Play(move);
+    if (other_solvable) history.push_back(move);
+  }
+
+  // Roll back history to the last state with at most max_solutions solutions.
+  auto Replay = [&history](size_t n) {
+    State s;
+    for (size_t i = 0; i < n; ++i) s.Play(history[i]);
+    return s;
+  };
+  assert(Replay(history.size()).CountSolutions(2).count == 1);
+  size_t n = history.size();
+  while (n > 0 && Replay(n - 1).CountSolutions(arg_max_solutions + 1).count <= arg_max_solutions) {
+    --n;
+  }
+
+  State grid = Replay(n);
+  std::ostringstream oss;
+  oss << std::setw(4) << case_index << ' ' << n << ' ';
+  for (int i = 0; i < 81; ++i) oss << (grid.IsFree(i) ? '.' : (char) ('0' + grid.Digit(i)));
+  return oss.str();
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (!ParseOptions(argc, argv) || arg_help || arg_cases < 0 || arg_max_solutions < 1) {
+    std::ostream &os = arg_help ? std::cout : std::clog;
+    os << "Usage: generate [<options>]\n\nOptions:\n";
+    PrintOptionUsage(os);
+    return EXIT_FAILURE;
+  }
+
+  rng_seed_t seed;
+  if (arg_seed.empty()) {
+    seed = GenerateSeed(4);
+  } else if (auto s = ParseSeed(arg_seed)) {
+    seed = *s;
+  } else {
+    LogError() << "Could not parse RNG seed: [" << arg_seed << "]";
+    return EXIT_FAILURE;
+  }
+  LogSeed(seed);
+
+  // Cases that have been generated, but not printed yet.
+  std::map<int64_t, std::string> results;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<int64_t> next_case = 0;
+
+  auto worker = [&]() {
+    for (int64_t i; (i = next_case++) < arg_cases; ) {
+      std::string line = GenerateCase(i, seed);
+      std::lock_guard<std::mutex> lock(mutex);
+      results[i] = std::move(line);
+      cv.notify_one();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < arg_jobs && i < arg_cases; ++i) threads.emplace_back(worker);
+
+  for (int64_t i = 0; i < arg_cases; ++i) {
+    std::string line;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&results, i]() { return results.contains(i); });
+      line = std::move(results[i]);
+      results.erase(i);
+    }
+    std::cout << line << '\n';
+  }
+  std::cout << std::flush;
+
+  for (std::thread &thread : threads) thread.join();
+  return EXIT_SUCCESS;
+}
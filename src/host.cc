@@ -0,0 +1,336 @@
+// Hosts many concurrent games in a single process, which share one memo.
+//
+// Since memo keys depend only on the solution set, analysis results carry over
+// between games, and one large memo serves all games much better than a
+// separate memo per player process. With --memo-shm, the memo is also shared
+// with other hosts, players, and analysis tools on the same machine.
+//
+// The host listens on a Unix domain socket. Each connection plays a single
+// game using the same line protocol as the player on standard input/output.
+// At most --jobs games select a turn at the same time; the others wait.
+//
+// The same binary also has a client mode that relays standard input and
+// output to the host, so it can be used as a player command for arbiter.py:
+//
+//   host --socket=/tmp/sudoku.sock --player=default,time-limit=28 &
+//   ./arbiter.py "host --connect=/tmp/sudoku.sock" "output/release/player"
+
+#include "arena.h"
+#include "logging.h"
+#include "memo.h"
+#include "options.h"
+#include "random.h"
+#include "state.h"
+#include "strategy.h"
+#include "timer.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <semaphore>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace {
+
+DECLARE_OPTION(bool, arg_help, false, "help",
+    "show usage information");
+
+DECLARE_OPTION(std::string, arg_socket, "", "socket",
+    "Path of the Unix domain socket to listen on.");
+
+DECLARE_OPTION(std::string, arg_connect, "", "connect",
+    "Client mode: relay standard input and output to the host listening on "
+    "the given socket path.");
+
+DECLARE_OPTION(std::string, arg_player, "default", "player",
+    "Specification of the player (see arena.h for the syntax). The memo-size "
+    "key is ignored, since all games share a single memo.");
+
+DECLARE_OPTION(int, arg_jobs, std::max(1u, std::thread::hardware_concurrency()), "jobs",
+    "Maximum number of games that select a turn at the same time.");
+
+DECLARE_OPTION(int64_t, arg_memo_size, LossyMemo::default_size, "memo-size",
+    "Number of entries in the shared memo (must be a power of 2).");
+
+DECLARE_OPTION(std::string, arg_memo_shm, "", "memo-shm",
+    "If nonempty, the name of a POSIX shared memory object (e.g. /sudoku-memo) "
+    "that holds the memo, so that it is also shared with other processes that "
+    "use the same name. It is created with --memo-size entries if it does not "
+    "exist yet.");
+
+DECLARE_OPTION(std::string, arg_seed, "", "seed",
+    "Random seed in hexadecimal format. If empty, pick randomly. Game i is "
+    "played with the seed followed by i.");
+
+// Buffered reading and writing of a socket.
+class Connection {
+public:
+  explicit Connection(int fd) : fd(fd) {}
+  ~Connection() { close(fd); }
+
+  Connection(const Connection &) = delete;
+  Connection &operator=(const Connection &) = delete;
+
+  // Reads the next whitespace-separated token (the player reads its input
+  // the same way). Returns false at the end of input.
+  bool ReadToken(std::string &token) {
+    token.clear();
+    for (int ch; (ch = ReadChar()) >= 0; ) {
+      if (!isspace(ch)) {
+        token += (char) ch;
+      } else if (!token.empty()) {
+        return true;
+      }
+    }
+    return !token.empty();
+  }
+
+  bool WriteLine(std::string line) {
+    line += '\n';
+    for (size_t pos = 0; pos < line.size(); ) {
+      ssize_t n = send(fd, line.data() + pos, line.size() - pos, MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return false;
+      pos += n;
+    }
+    return true;
+  }
+
+private:
+  int ReadChar() {
+    if (pos == size) {
+      ssize_t n;
+      do n = read(fd, buffer, sizeof(buffer)); while (n < 0 && errno == EINTR);
+      if (n <= 0) return -1;
+      pos = 0;
+      size = n;
+    }
+    return (unsigned char) buffer[pos++];
+  }
+
+  int fd;
+  char buffer[4096];
+  size_t pos = 0;
+  size_t size = 0;
+};
+
+std::optional<Move> ParseMove(const std::string &s) {
+  if (s.size() != 3 ||
+      s[0] < 'A' || s[0] > 'I' ||
+      s[1] < 'a' || s[1] > 'i' ||
+      s[2] < '1' || s[2] > '9') return {};
+  return Move{.pos = 9*(s[0] - 'A') + (s[1] - 'a'), .digit = s[2] - '0'};
+}
+
+std::string FormatTurn(const Turn &turn) {
+  std::ostringstream oss;
+  oss << turn;
+  return oss.str();
+}
+
+struct Host {
+  PlayerConfig config;
+  std::unique_ptr<memo_t> memo;
+  std::counting_semaphore<> turn_slots;
+  rng_seed_t seed;
+  std::atomic<int> active_games = 0;
+
+  Host(const PlayerConfig &config, std::unique_ptr<memo_t> memo, int jobs, const rng_seed_t &seed)
+    : config(config), memo(std::move(memo)), turn_slots(jobs), seed(seed) {}
+};
+
+// Plays a single game over the given connection, until the input ends or
+// "Quit" is received. Returns the number of turns played.
+int PlayGame(Host &host, Connection &conn, int game_id) {
+  rng_seed_t game_seed = host.seed;
+  game_seed.push_back(game_id);
+  rng_t rng = CreateRng(game_seed);
+  Strategy strategy(host.config.params, false, host.memo.get());
+
+  std::string input;
+  if (!conn.ReadToken(input) || input == "Quit") return 0;
+  const int my_player = (input == "Start" ? 0 : 1);
+
+  // Like the player, only count time while we are selecting a turn (which
+  // includes waiting for a free slot).
+  Timer timer;
+  for (int turn = 0;; ++turn) {
+    if (turn % 2 == my_player) {
+      TurnInfo info;
+      host.turn_slots.acquire();
+      info = strategy.SelectTurn(rng, timer.Elapsed());
+      host.turn_slots.release();
+      if (info.turn.Empty()) return turn;
+      for (const Move &move : info.turn.Moves()) strategy.PlayMove(move);
+      timer.Pause();
+      if (!conn.WriteLine(FormatTurn(info.turn))) return turn;
+    } else {
+      if (turn > 0) {
+        if (!conn.ReadToken(input) || input == "Quit") return turn;
+        timer.Resume();
+      }
+      std::optional<Move> move = ParseMove(input);
+      if (!move || !strategy.GetState().CanPlay(*move)) {
+        LogError() << "Game " << game_id << ": invalid move received: " << input;
+        return turn;
+      }
+      strategy.PlayMove(*move);
+    }
+  }
+}
+
+int Listen(const std::string &path) {
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    LogError() << "Socket path too long: " << path;
+    return -1;
+  }
+  strcpy(addr.sun_path, path.c_str());
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    LogError() << "socket(): " << strerror(errno);
+    return -1;
+  }
+  unlink(path.c_str());
+  if (bind(fd, (const sockaddr*) &addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+    LogError() << "Could not listen on " << path << ": " << strerror(errno);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int Connect(const std::string &path) {
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    LogError() << "Socket path too long: " << path;
+    return -1;
+  }
+  strcpy(addr.sun_path, path.c_str());
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (const sockaddr*) &addr, sizeof(addr)) != 0) {
+    LogError() << "Could not connect to " << path << ": " << strerror(errno);
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int RunHost() {
+  StrategyParams base_params;
+  auto config = ParsePlayerConfig(arg_player, base_params);
+  if (!config) {
+    LogError() << "Invalid player specification: [" << arg_player << "]";
+    return EXIT_FAILURE;
+  }
+  if (arg_memo_size <= 0 || (arg_memo_size & (arg_memo_size - 1)) != 0) {
+    LogError() << "Memo size must be a power of 2!";
+    return EXIT_FAILURE;
+  }
+  rng_seed_t seed;
+  if (arg_seed.empty()) {
+    seed = GenerateSeed(4);
+  } else if (auto s = ParseSeed(arg_seed)) {
+    seed = *s;
+  } else {
+    LogError() << "Could not parse RNG seed: [" << arg_seed << "]";
+    return EXIT_FAILURE;
+  }
+  LogSeed(seed);
+
+  std::unique_ptr<memo_t> memo;
+  if (arg_memo_shm.empty()) {
+    memo = std::make_unique<memo_t>(arg_memo_size);
+  } else {
+    std::string error;
+    memo = LossyMemo::OpenShared(arg_memo_shm, arg_memo_size, error);
+    if (!memo) {
+      LogError() << error;
+      return EXIT_FAILURE;
+    }
+  }
+
+  int listen_fd = Listen(arg_socket);
+  if (listen_fd < 0) return EXIT_FAILURE;
+  LogInfo() << "Listening on " << arg_socket;
+
+  // Shared by all games, which run on detached threads, so it is never freed.
+  Host *host = new Host(*config, std::move(memo), std::max(arg_jobs, 1), seed);
+  for (int game_id = 0;; ++game_id) {
+    int fd;
+    do fd = accept(listen_fd, nullptr, nullptr); while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+      LogError() << "accept(): " << strerror(errno);
+      return EXIT_FAILURE;
+    }
+    std::thread([host, fd, game_id]() {
+      int active = ++host->active_games;
+      LogInfo() << "Game " << game_id << " started (" << active << " active)";
+      Connection conn(fd);
+      Timer timer;
+      int turns = PlayGame(*host, conn, game_id);
+      --host->active_games;
+      LogInfo() << "Game " << game_id << " ended after " << turns << " turns in "
+          << timer.Elapsed() << " ms";
+    }).detach();
+  }
+}
+
+// Copies data from standard input to the socket and back, until either side
+// closes its end.
+int RunClient() {
+  int fd = Connect(arg_connect);
+  if (fd < 0) return EXIT_FAILURE;
+  pollfd fds[2] = {{.fd = STDIN_FILENO, .events = POLLIN, .revents = 0},
+                   {.fd = fd, .events = POLLIN, .revents = 0}};
+  char buffer[4096];
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      return EXIT_FAILURE;
+    }
+    for (int i = 0; i < 2; ++i) {
+      if (fds[i].revents == 0) continue;
+      ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+      if (n <= 0) return EXIT_SUCCESS;
+      int out = i == 0 ? fd : STDOUT_FILENO;
+      for (ssize_t pos = 0; pos < n; ) {
+        ssize_t m = write(out, buffer + pos, n - pos);
+        if (m <= 0) return EXIT_FAILURE;
+        pos += m;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (!ParseOptions(argc, argv) || arg_help ||
+      arg_socket.empty() == arg_connect.empty()) {
+    std::ostream &os = arg_help ? std::cout : std::clog;
+    os << "Usage: host --socket=<path> [<options>]\n"
+          "       host --connect=<path>\n\nOptions:\n";
+    PrintOptionUsage(os);
+    return EXIT_FAILURE;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  return arg_connect.empty() ? RunHost() : RunClient();
+}
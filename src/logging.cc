@@ -0,0 +1,156 @@
+#include "logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+// Bounded multi-producer single-consumer queue of log lines, based on Dmitry
+// Vyukov's bounded MPMC queue: each slot has a sequence number which tells
+// producers and the consumer whose turn it is to use the slot, so neither side
+// ever takes a lock.
+//
+// Lines longer than a slot are split over consecutive slots. (If several
+// threads write such long lines concurrently, the parts may interleave.)
+//
+// The queue holds 1024 chunks of up to 240 bytes (256 KB in total), which is
+// far more than the player logs in a single turn.
+class LogQueue {
+public:
+  static constexpr size_t slot_count = 1024;
+  static constexpr size_t max_chunk_size = 240;
+
+  LogQueue() {
+    for (size_t i = 0; i < slot_count; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  // Tries to add a chunk of a line. Returns false if the queue is full.
+  bool TryPush(std::string_view chunk, bool end_of_line) {
+    size_t pos = head.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+      slot = &slots[pos % slot_count];
+      size_t sequence = slot->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+      if (diff == 0) {
+        if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        return false;  // full
+      } else {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+    slot->size = chunk.size();
+    slot->end_of_line = end_of_line;
+    std::copy(chunk.begin(), chunk.end(), slot->data);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Appends the next chunk to `output`. Returns false if the queue is empty.
+  // Must only be called by the consumer thread.
+  bool TryPop(std::string &output) {
+    Slot &slot = slots[tail % slot_count];
+    if (slot.sequence.load(std::memory_order_acquire) != tail + 1) return false;
+    output.append(slot.data, slot.size);
+    if (slot.end_of_line) output += '\n';
+    slot.sequence.store(tail + slot_count, std::memory_order_release);
+    ++tail;
+    return true;
+  }
+
+private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    uint32_t size;
+    bool end_of_line;
+    char data[max_chunk_size];
+  };
+
+  Slot slots[slot_count];
+  alignas(64) std::atomic<size_t> head = 0;
+  alignas(64) size_t tail = 0;
+};
+
+struct AsyncLogger {
+  LogQueue queue;
+  std::atomic<bool> enabled = false;
+
+  // Number of lines dropped because the queue was full, since the queue was
+  // last drained.
+  std::atomic<size_t> dropped = 0;
+
+  // Held while draining the queue, since the queue allows only one consumer.
+  std::mutex consumer_mutex;
+};
+
+AsyncLogger async_logger;
+
+void WriteAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = write(fd, data.data(), data.size());
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return;
+    data.remove_prefix(n);
+  }
+}
+
+// Drains the queue, writing all lines that are available with a single
+// write() call, followed by a note if any lines were dropped.
+void DrainQueue() {
+  std::lock_guard<std::mutex> lock(async_logger.consumer_mutex);
+  std::string output;
+  while (async_logger.queue.TryPop(output)) {}
+  if (size_t dropped = async_logger.dropped.exchange(0, std::memory_order_relaxed)) {
+    // A line may have been cut off when the queue filled up.
+    if (!output.empty() && output.back() != '\n') output += '\n';
+    output += "(" + std::to_string(dropped) + " log lines dropped: queue full)\n";
+  }
+  WriteAll(STDERR_FILENO, output);
+}
+
+void StopAsyncLogging() {
+  if (!async_logger.enabled.load()) return;
+  async_logger.enabled.store(false);
+  DrainQueue();
+}
+
+// Never blocks: if the queue is full, the rest of the line is dropped and
+// counted instead, so that logging can't stall the thread that logs.
+void PushLine(std::string_view line) {
+  do {
+    std::string_view chunk = line.substr(0, LogQueue::max_chunk_size);
+    line.remove_prefix(chunk.size());
+    if (!async_logger.queue.TryPush(chunk, line.empty())) {
+      async_logger.dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  } while (!line.empty());
+}
+
+}  // namespace
+
+void StartAsyncLogging() {
+  if (async_logger.enabled.load()) return;
+  std::clog.flush();
+  async_logger.enabled.store(true);
+  atexit(StopAsyncLogging);
+}
+
+void FlushAsyncLog() {
+  if (async_logger.enabled.load(std::memory_order_relaxed)) DrainQueue();
+}
+
+void WriteLogLine(std::ostream &os, std::string_view line) {
+  if (&os == &std::clog && async_logger.enabled.load(std::memory_order_relaxed)) {
+    PushLine(line);
+  } else {
+    os << line << std::endl;
+  }
+}
@@ -20,41 +20,66 @@
 #include "analysis.h"
 #include "random.h"
 #include "state.h"
+#include "stats.h"
 
 #include <chrono>
 #include <cstdint>
 #include <limits>
 #include <iostream>
+#include <sstream>
 #include <string_view>
 
 // Granularity of time used in log files.
 using log_duration_t = std::chrono::milliseconds;
 
+// Starts asynchronous logging. Afterwards, log lines written to std::clog are
+// added to a lock-free queue instead, so logging doesn't make a system call
+// on the thread that logs (e.g. while it is timing its own turn). Queued lines
+// are written by FlushAsyncLog(). Logging never blocks: if the queue fills up
+// between flushes, further lines are dropped, and the number of dropped lines
+// is logged by the next flush.
+//
+// Remaining lines are written when the process exits normally, but lines
+// still in the queue are lost if the process crashes or is killed.
+void StartAsyncLogging();
+
+// Writes all queued log lines to stderr, on the calling thread. Does nothing
+// if asynchronous logging is not enabled. The player calls this once per
+// turn, after pausing its timer, and before writing its move, since the
+// referee may kill or suspend the process after the last move.
+void FlushAsyncLog();
+
+// Writes a log line (without the trailing newline) to `os`. This is used by
+// LogStream, and should not be called directly.
+void WriteLogLine(std::ostream &os, std::string_view line);
+
 // Line-buffered log entry.
 //
-// Always starts with a tag followed by a space, and ends with a newline.
+// Always starts with a tag followed by a space, and ends with a newline. The
+// line is written all at once when the entry is destroyed.
 class LogStream {
 public:
   LogStream(std::string_view tag, std::ostream &os = std::clog) : os(os) {
-    if (!tag.empty()) os << tag << ' ';
+    if (!tag.empty()) line << tag << ' ';
   }
 
-  ~LogStream() { os << std::endl; }
+  ~LogStream() { WriteLogLine(os, line.view()); }
 
   LogStream &operator<<(const log_duration_t &value) {
     // I could add an `ms` suffix, but logs are shorter and easier to parse without it.
-    os << value.count();
+    line << value.count();
     return *this;
   }
 
   template<class T>
   LogStream &operator<<(const T &value) {
-    os << value;
+    line << value;
     return *this;
   }
 
 private:
   std::ostream &os;
+  std::ostringstream line;
 };
 
 // Log an arbitrary informational message.
@@ -132,4 +157,12 @@ inline void LogPause(log_duration_t interval, log_duration_t total) {
   LogStream("PAUSE") << interval << " " << total;
 }
 
+// Log a compact summary of the analysis statistics (see stats.h) collected so
+// far. This is only written when --collect-stats is enabled.
+inline void LogStats(const Stats &stats) {
+  std::ostringstream oss;
+  PrintStatsCompact(oss, stats);
+  LogStream("STATS") << oss.str();
+}
+
 #endif  // ndef LOGGING_H_INCLUDED
@@ -5,15 +5,34 @@
 // IsWinning2(). This is used in analysis.cc to cache computations, which is
 // beneficial because different sequences of moves often lead to the same
 // solutions.
+//
+// Instead of a result, a memo may store a hint: a small positive integer that
+// identifies the move to try first when the position is searched again (0
+// means no hint). Hints are only stored for positions whose search was
+// aborted. (A position with a result is never searched again, so a hint
+// stored with it would never be used.)
 
 #ifndef MEMO_H_INCLUDED
 #define MEMO_H_INCLUDED
 
 #include "counters.h"
 
-#include <array>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
 #include <unordered_map>
 
 using memo_key_t = uint64_t;
@@ -21,10 +40,14 @@ using memo_key_t = uint64_t;
 // Dummy memo that can be used to disable the memo.
 class DummyMemo {
 public:
+  explicit DummyMemo(size_t size = 0) { (void) size; }
+
   struct Value {
     bool HasValue() const { return false; }
     bool GetWinning() const { assert(false); }
+    int GetHint() const { return 0; }
     void SetWinning(bool b) { (void) b; }
+    void SetHint(int hint) { (void) hint; }
   };
 
   Value Lookup(memo_key_t key) { (void) key; return Value(); }
@@ -34,15 +57,19 @@ public:
 // correctness (i.e. for the same hash, the same result written).
 class WriteonlyMemo {
 public:
+  explicit WriteonlyMemo(size_t size = 0) { (void) size; }
+
   struct Value {
     uint8_t *data = nullptr;
 
     bool HasValue() const { return false; }
     bool GetWinning() const { assert(false); }
+    int GetHint() const { return 0; }
     void SetWinning(bool b) {
       if (HasValue()) assert(GetWinning() == b);
       *data = b + 1;
     }
+    void SetHint(int hint) { (void) hint; }
   };
 
   Value Lookup(memo_key_t key) { return Value{&data[key]}; }
@@ -61,12 +88,16 @@ private:
 // This assumption doesn't hold for most flat hash table implementations!
 class RealMemo {
 public:
+  explicit RealMemo(size_t size = 0) { (void) size; }
+
   struct Value {
     uint8_t *data = nullptr;
 
     bool HasValue() const { return *data != 0; }
     bool GetWinning() const { return *data - 1; }
+    int GetHint() const { return 0; }
     void SetWinning(bool b) { *data = b + 1; }
+    void SetHint(int hint) { (void) hint; }
   };
 
   Value Lookup(memo_key_t key) { return Value{&data[key]}; }
@@ -79,59 +110,264 @@ private:
 //
 // The data is stored in an array of 64-bit integers. Each entry stores:
 //
-//  - The top 56 bits of the memo key. (Note that the lower bits are redundant
+//  - The top 48 bits of the memo key. (Note that the lower bits are redundant
 //    when size is a power of 2, since they are implied by the index in the
-//    array, so we could get away with storing even less.)
+//    array, so for memos of at least 2^16 entries, nothing is lost by not
+//    storing the lower 16 bits.)
 //
-//  - An 8 bit value describing the status of the position:
-//    0 for uninitialized, 1 for losing, 2 for winning.
+//  - A 16 bit value, where the lowest 2 bits describe the status of the
+//    position (0 for unknown, 1 for losing, 2 for winning). If the status is
+//    unknown, the remaining bits contain the hint (see above), which must be
+//    less than 2^14; otherwise they are 0.
 //
 // If two hash keys map to the same array entry, whichever one called
 // SetWinning() last wins.
+//
+// The memo can be shared by threads that analyze concurrently. Entries are
+// accessed with relaxed atomic operations (which compile to plain loads and
+// stores), and since the key and value share a single 64-bit word, a reader
+// never sees a value paired with the wrong key. Concurrent writers simply
+// overwrite each other, like colliding keys do.
+//
+// For the same reason, the memo can be shared by processes: OpenShared()
+// maps the table from a named POSIX shared memory object, so that processes
+// that run concurrently on the same machine (and later ones) reuse each
+// other's results. Memo keys are deterministic hashes of solution sets, so
+// they mean the same thing in every process.
 class LossyMemo {
 public:
   // 64 × 2^20 = about 67 million entries. Each entry takes 8 bytes, so total memory used is 512 MB.
-  //static const size_t size = 64 << 20;
+  //static const size_t default_size = 64 << 20;
   // 128 would uses 1 GB:
-  static const size_t size = 128 << 20;
-
-  static_assert(size > 0 && (size & (size - 1)) == 0, "size must be a power of 2");
+  static const size_t default_size = 128 << 20;
 
-  static constexpr uint64_t value_mask = 0xff;
+  static constexpr uint64_t value_mask = 0xffff;
+  static constexpr uint64_t status_mask = 0x3;
   static constexpr uint64_t key_mask = ~value_mask;
+  static constexpr int max_hint = (1 << 14) - 1;
 
   struct Value {
     uint64_t masked_key;
     uint64_t *entry;
 
+    // Copy of the entry at the time of the lookup. (Other threads may change
+    // the entry concurrently, so it must only be read once.)
+    uint64_t snapshot;
+
     bool HasValue() const {
-      return (*entry & key_mask) == masked_key && (*entry & value_mask) != 0;
+      return (snapshot & key_mask) == masked_key && (snapshot & status_mask) != 0;
     }
 
     bool GetWinning() const {
-      return (*entry & value_mask) - 1;
+      return (snapshot & status_mask) - 1;
+    }
+
+    // Returns the hint stored for this key, if it has no value.
+    int GetHint() const {
+      return (snapshot & key_mask) == masked_key ? (snapshot & value_mask) >> 2 : 0;
     }
 
     void SetWinning(bool b) {
-      if ((*entry & key_mask) != 0 && (*entry & key_mask) != masked_key) [[unlikely]] {
+      std::atomic_ref<uint64_t> ref(*entry);
+      uint64_t old_key = ref.load(std::memory_order_relaxed) & key_mask;
+      if (old_key != 0 && old_key != masked_key) [[unlikely]] {
         counters.memo_collisions.Inc();
       }
 
       // Unconditionally overwrite previous value!
-      *entry = masked_key | (b + 1);
+      ref.store(masked_key | (b + 1), std::memory_order_relaxed);
+    }
+
+    // Stores a hint without a result. Since a hint is less valuable than a
+    // result, this does not overwrite an entry that has a result (which may
+    // have been stored by another thread since the lookup).
+    void SetHint(int hint) {
+      assert(hint > 0 && hint <= max_hint);
+      std::atomic_ref<uint64_t> ref(*entry);
+      if ((ref.load(std::memory_order_relaxed) & status_mask) != 0) return;
+      ref.store(masked_key | ((uint64_t) hint << 2), std::memory_order_relaxed);
     }
   };
 
+  // `size` is the number of entries, which must be a power of 2.
+  explicit LossyMemo(size_t size = default_size) : size(size), data(Allocate(size), Deleter{0}) {
+    assert(size > 0 && (size & (size - 1)) == 0);
+  }
+
+  // Identifies the format of shared memos: the entry layout described above,
+  // and the memo keys calculated by analysis.cc. This must be incremented when
+  // either changes, so that processes never attach to a shared memo written
+  // by a build that interprets it differently.
+  static constexpr uint32_t shared_format_version = 1;
+
+  // Attaches to the memo stored in the shared memory object `name` (e.g.
+  // "/sudoku-memo"), creating it with `size` entries if it does not exist
+  // yet. When attaching to an existing object, its size is used instead, so
+  // the table is sized once, by the process that creates it.
+  //
+  // The object starts with a header page that records the format, which is
+  // checked when attaching. All memory is reserved when the object is
+  // created, so running out of space in /dev/shm is reported here, rather
+  // than killing the process with SIGBUS when it first writes an entry.
+  //
+  // Processes may attach and detach at any time. The object is not removed
+  // when the last process detaches; remove it with shm_unlink() (or by
+  // deleting the file in /dev/shm) to clear the memo.
+  //
+  // Note that processes that share a memo benefit from each other's work, so
+  // their timings are not independent. In particular, games between two
+  // players that share a memo cannot be used to compare the players.
+  //
+  // Returns null and sets `error` on failure.
+  static std::unique_ptr<LossyMemo> OpenShared(
+      const std::string &name, size_t size, std::string &error) {
+    assert(size > 0 && (size & (size - 1)) == 0);
+    auto Fail = [&](const std::string &message) {
+      error = "Shared memo " + name + ": " + message;
+      return nullptr;
+    };
+    auto FailErrno = [&](const char *function) {
+      return Fail(std::string(function) + "(): " + strerror(errno));
+    };
+
+    bool created = true;
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+      if (errno != EEXIST) return FailErrno("shm_open");
+      created = false;
+      fd = shm_open(name.c_str(), O_RDWR, 0);
+      if (fd < 0) return FailErrno("shm_open");
+    }
+    // The descriptor is not needed after mapping the object.
+    struct FdCloser {
+      int fd;
+      ~FdCloser() { close(fd); }
+    } fd_closer{fd};
+
+    if (created) {
+      // posix_fallocate() sets the size and reserves the memory. The object
+      // is filled with zeroes, which represent unknown entries.
+      if (int err = posix_fallocate(fd, 0, shared_header_size + size * sizeof(uint64_t)); err != 0) {
+        shm_unlink(name.c_str());
+        errno = err;
+        return FailErrno("posix_fallocate");
+      }
+    } else {
+      // Another process created the object, and may not have set its size
+      // yet, so wait for that (briefly) before using it.
+      struct stat st;
+      if (fstat(fd, &st) != 0) return FailErrno("fstat");
+      for (int attempt = 0; st.st_size == 0 && attempt < shared_attach_attempts; ++attempt) {
+        std::this_thread::sleep_for(shared_attach_interval);
+        if (fstat(fd, &st) != 0) return FailErrno("fstat");
+      }
+      if ((size_t) st.st_size <= shared_header_size) {
+        return Fail("not a shared memo (size " + std::to_string(st.st_size) + ")");
+      }
+      size = (st.st_size - shared_header_size) / sizeof(uint64_t);
+    }
+
+    const size_t mapped_bytes = shared_header_size + size * sizeof(uint64_t);
+    void *p = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) return FailErrno("mmap");
+    // Unmaps the object if it turns out to be unusable.
+    struct Unmapper {
+      void *p;
+      size_t bytes;
+      ~Unmapper() { if (p != nullptr) munmap(p, bytes); }
+    } unmapper{p, mapped_bytes};
+
+    // The creator writes the magic number last, so that other processes only
+    // read the rest of the header after it is complete.
+    SharedHeader &header = *static_cast<SharedHeader*>(p);
+    std::atomic_ref<uint64_t> magic(header.magic);
+    if (created) {
+      header.version = shared_format_version;
+      header.entry_size = sizeof(uint64_t);
+      header.entry_count = size;
+      magic.store(shared_magic, std::memory_order_release);
+    } else {
+      for (int attempt = 0; magic.load(std::memory_order_acquire) == 0 &&
+          attempt < shared_attach_attempts; ++attempt) {
+        std::this_thread::sleep_for(shared_attach_interval);
+      }
+      if (magic.load(std::memory_order_acquire) != shared_magic) {
+        return Fail("not a shared memo (wrong magic number)");
+      }
+      if (header.version != shared_format_version || header.entry_size != sizeof(uint64_t)) {
+        return Fail("written by an incompatible build (format version " +
+            std::to_string(header.version) + ", entry size " +
+            std::to_string(header.entry_size) + "; expected " +
+            std::to_string(shared_format_version) + " and " +
+            std::to_string(sizeof(uint64_t)) + "); remove it to create a new one");
+      }
+      if (header.entry_count != size || size == 0 || (size & (size - 1)) != 0) {
+        return Fail("entry count " + std::to_string(header.entry_count) +
+            " does not match its size");
+      }
+    }
+    unmapper.p = nullptr;
+    return std::unique_ptr<LossyMemo>(new LossyMemo(size, std::unique_ptr<uint64_t[], Deleter>(
+        reinterpret_cast<uint64_t*>(static_cast<char*>(p) + shared_header_size),
+        Deleter{mapped_bytes})));
+  }
+
+  size_t Size() const { return size; }
+
   Value Lookup(memo_key_t key) {
-    return Value{key & key_mask, &data[(size_t) key % size]};
+    uint64_t *entry = &data[(size_t) key & (size - 1)];
+    return Value{key & key_mask, entry,
+        std::atomic_ref<uint64_t>(*entry).load(std::memory_order_relaxed)};
   }
 
 private:
-  std::array<uint64_t, size> data;
+  // Header of shared memos, in the first page of the shared memory object.
+  // The entries start at the next page.
+  struct SharedHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t entry_size;
+    uint64_t entry_count;
+  };
+
+  static constexpr uint64_t shared_magic = 0x4f4d454d4f445553;  // "SUDOMEMO"
+  static constexpr size_t shared_header_size = 4096;
+
+  // How long OpenShared() waits for another process to initialize a new
+  // shared memo.
+  static constexpr int shared_attach_attempts = 500;
+  static constexpr std::chrono::milliseconds shared_attach_interval{10};
+
+  // Frees memory allocated by Allocate(), or unmaps the memory mapped by
+  // OpenShared() (including the header) if `mapped_bytes` is nonzero.
+  struct Deleter {
+    size_t mapped_bytes;
+
+    void operator()(uint64_t *p) const {
+      if (mapped_bytes == 0) {
+        free(p);
+      } else {
+        munmap(reinterpret_cast<char*>(p) - shared_header_size, mapped_bytes);
+      }
+    }
+  };
+
+  LossyMemo(size_t size, std::unique_ptr<uint64_t[], Deleter> data)
+      : size(size), data(std::move(data)) {}
+
+  // Allocates zero-initialized memory with calloc(), which (for large sizes)
+  // maps fresh pages from the OS that are only backed by physical memory when
+  // they are first touched, just like the blank segment of the binary. Most
+  // analysis runs touch only a fraction of the memo, so this keeps memory use
+  // proportional to the work done.
+  static uint64_t *Allocate(size_t size) {
+    void *p = calloc(size, sizeof(uint64_t));
+    if (p == nullptr) throw std::bad_alloc();
+    return static_cast<uint64_t*>(p);
+  }
 
-  // Declare data as a vector to allocate memory on the heap instead of the
-  // blank segment of the binary. This is necessary for larger sizes.
-  //std::vector<uint64_t> data = std::vector<uint64_t>(size);
+  size_t size;
+  std::unique_ptr<uint64_t[], Deleter> data;
 };
 
 // Change the type of memo here to enable/disable memoization.
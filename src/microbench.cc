@@ -0,0 +1,385 @@
+// Microbenchmarks for the inner kernels of the solver and the analysis.
+//
+// Inputs are taken from one of the data/*-cases.txt corpora: for each case,
+// all solutions are enumerated and the kernels are run against those.
+//
+// For each benchmark, the time per operation is reported as the mean and
+// standard deviation over several repetitions. If hardware performance
+// counters are available (through perf_event_open(); see
+// /proc/sys/kernel/perf_event_paranoid), cycles, instructions, branch misses
+// and cache misses per operation are reported too.
+//
+// Example:
+//
+//  % output/release/microbench --filter=Filter
+
+#include "analysis.h"
+#include "analysis_internal.h"
+#include "memo.h"
+#include "options.h"
+#include "random.h"
+#include "state.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+using namespace analysis::internal;
+
+DECLARE_OPTION(bool, arg_help, false, "help",
+    "show usage information");
+DECLARE_OPTION(std::string, arg_cases, "data/random-play-until-2k-cases.txt", "cases",
+    "file with cases (in the format of data/*-cases.txt) used as inputs");
+DECLARE_OPTION(int, arg_max_cases, 20, "max-cases",
+    "maximum number of cases to use");
+DECLARE_OPTION(int, arg_max_solutions, 100'000, "max-solutions",
+    "skip cases with more solutions than this");
+DECLARE_OPTION(std::string, arg_filter, "", "filter",
+    "only run benchmarks whose name contains this string");
+DECLARE_OPTION(int, arg_repetitions, 10, "repetitions",
+    "number of timed repetitions per benchmark");
+DECLARE_OPTION(int, arg_min_time_ms, 100, "min-time-ms",
+    "minimum duration of a single repetition in milliseconds");
+DECLARE_OPTION(int64_t, arg_memo_size, LossyMemo::default_size, "memo-size",
+    "number of memo entries used in the memo benchmark");
+DECLARE_OPTION(int, arg_memo_keys, 1 << 20, "memo-keys",
+    "number of random keys used in the memo benchmark");
+
+// Prevents the compiler from optimizing away the computation of `value`.
+template<class T> void DoNotOptimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// A group of hardware performance counters for the current thread.
+//
+// If perf_event_open() is not available, Available() returns false and the
+// other methods do nothing.
+class PerfCounters {
+public:
+  static constexpr int count = 4;
+  static constexpr const char *names[count] = {"cycles", "instrs", "br-miss", "cache-miss"};
+
+  using Values = std::array<uint64_t, count>;
+
+#ifdef __linux__
+  PerfCounters() {
+    static constexpr uint64_t configs[count] = {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_BRANCH_MISSES,
+      PERF_COUNT_HW_CACHE_MISSES,
+    };
+    for (int i = 0; i < count; ++i) {
+      perf_event_attr attr = {};
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof(attr);
+      attr.config = configs[i];
+      attr.disabled = i == 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      int fd = syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+      if (fd < 0) {
+        Close();
+        return;
+      }
+      fds[i] = fd;
+    }
+  }
+
+  ~PerfCounters() { Close(); }
+
+  bool Available() const { return fds[0] >= 0; }
+
+  void Start() {
+    if (!Available()) return;
+    ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  Values Stop() {
+    Values values = {};
+    if (!Available()) return values;
+    ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    uint64_t buf[1 + count] = {};
+    if (read(fds[0], buf, sizeof(buf)) == sizeof(buf) && buf[0] == count) {
+      std::copy(buf + 1, buf + 1 + count, values.begin());
+    }
+    return values;
+  }
+
+private:
+  void Close() {
+    for (int &fd : fds) {
+      if (fd >= 0) close(fd);
+      fd = -1;
+    }
+  }
+
+  int fds[count] = {-1, -1, -1, -1};
+#else
+  bool Available() const { return false; }
+  void Start() {}
+  Values Stop() { return Values{}; }
+#endif
+};
+
+PerfCounters *perf_counters = nullptr;
+
+bool IsSelected(std::string_view name) {
+  return name.find(arg_filter) != std::string_view::npos;
+}
+
+// Runs `function` repeatedly, and prints statistics about the time per
+// operation, where each call to `function` performs `ops_per_call` operations.
+template<class F>
+void RunBenchmark(std::string_view name, int64_t ops_per_call, const F &function) {
+  using clock_t = std::chrono::steady_clock;
+  assert(ops_per_call > 0);
+
+  // Warm up, and determine how many calls are needed per repetition.
+  int64_t calls = 1;
+  for (;;) {
+    auto start = clock_t::now();
+    for (int64_t i = 0; i < calls; ++i) function();
+    auto elapsed = clock_t::now() - start;
+    if (elapsed >= std::chrono::milliseconds(arg_min_time_ms) || calls >= (int64_t{1} << 40)) break;
+    calls *= 2;
+  }
+
+  std::vector<double> ns_per_op;
+  PerfCounters::Values totals = {};
+  for (int rep = 0; rep < arg_repetitions; ++rep) {
+    perf_counters->Start();
+    auto start = clock_t::now();
+    for (int64_t i = 0; i < calls; ++i) function();
+    auto elapsed = clock_t::now() - start;
+    PerfCounters::Values values = perf_counters->Stop();
+    for (int i = 0; i < PerfCounters::count; ++i) totals[i] += values[i];
+    ns_per_op.push_back(
+        std::chrono::duration<double, std::nano>(elapsed).count() / (calls * ops_per_call));
+  }
+
+  double mean = 0, variance = 0;
+  for (double x : ns_per_op) mean += x;
+  mean /= ns_per_op.size();
+  for (double x : ns_per_op) variance += (x - mean) * (x - mean);
+  if (ns_per_op.size() > 1) variance /= ns_per_op.size() - 1;
+
+  std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+      << std::setprecision(1) << std::setw(12) << mean << " ns/op"
+      << " +- " << std::setw(5) << std::setprecision(1)
+      << (mean > 0 ? 100 * std::sqrt(variance) / mean : 0.0) << '%'
+      << " (min " << std::setprecision(1) << *std::ranges::min_element(ns_per_op) << ")";
+  if (perf_counters->Available()) {
+    double ops = (double) calls * ops_per_call * arg_repetitions;
+    for (int i = 0; i < PerfCounters::count; ++i) {
+      std::cout << "  " << PerfCounters::names[i] << '=' << std::setprecision(1) << totals[i] / ops;
+    }
+    if (totals[0] > 0) {
+      std::cout << "  IPC=" << std::setprecision(2) << (double) totals[1] / totals[0];
+    }
+  }
+  std::cout << std::endl;
+}
+
+// Benchmark input derived from a single case.
+struct Input {
+  State state;
+  std::vector<HashedSolution> solutions;
+  std::vector<position_t> choice_positions;
+  std::vector<RankedMove> moves;
+};
+
+std::optional<State> ParseGrid(std::string_view grid) {
+  if (grid.size() != 81) return {};
+  State state;
+  for (int i = 0; i < 81; ++i) {
+    if (grid[i] >= '1' && grid[i] <= '9') {
+      Move move = {.pos = i, .digit = grid[i] - '0'};
+      if (!state.CanPlay(move)) return {};
+      state.Play(move);
+    }
+  }
+  return state;
+}
+
+bool LoadInputs(const std::string &filename, std::vector<Input> &inputs) {
+  std::ifstream ifs(filename);
+  if (!ifs) {
+    std::cerr << "Could not open " << filename << std::endl;
+    return false;
+  }
+  std::string line;
+  for (int line_no = 1; std::getline(ifs, line) && (int) inputs.size() < arg_max_cases; ++line_no) {
+    // Format: <case number> <given count> <grid>
+    std::istringstream iss(line);
+    std::string case_no, given_count, grid;
+    std::optional<State> state;
+    if (!(iss >> case_no >> given_count >> grid) || !(state = ParseGrid(grid))) {
+      std::cerr << "Could not parse line " << line_no << " of " << filename << std::endl;
+      return false;
+    }
+
+    std::vector<solution_t> solutions;
+    EnumerateResult er = state->EnumerateSolutions(solutions, arg_max_solutions + 1);
+    if (!er.success || solutions.size() < 2) continue;
+
+    Input input;
+    input.state = *state;
+    for (const solution_t &solution : solutions) {
+      input.solutions.push_back(HashedSolution{Hash(solution), solution});
+    }
+    candidates_t candidates = CalculateCandidates(solutions);
+    for (int i = 0; i < 81; ++i) {
+      if (state->IsFree(i) && !Determined(candidates[i])) input.choice_positions.push_back(i);
+    }
+    input.moves = GenerateRankedMoves(input.solutions, input.choice_positions);
+    inputs.push_back(std::move(input));
+  }
+  if (inputs.empty()) {
+    std::cerr << "No usable cases found in " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void RunBenchmarks(std::vector<Input> &inputs) {
+  int64_t total_solutions = 0;
+  int64_t total_moves = 0;
+  for (const Input &input : inputs) {
+    total_solutions += input.solutions.size();
+    total_moves += input.moves.size();
+  }
+  std::cout << inputs.size() << " cases, " << total_solutions << " solutions, "
+      << total_moves << " moves\n\n";
+
+  // One operation is counting all solutions of a single case.
+  if (IsSelected("CountSolutions")) {
+    RunBenchmark("CountSolutions", inputs.size(), [&inputs]() {
+      for (Input &input : inputs) DoNotOptimize(input.state.CountSolutions().count);
+    });
+  }
+
+  // One operation is enumerating all solutions of a single case.
+  if (IsSelected("EnumerateSolutions")) {
+    RunBenchmark("EnumerateSolutions", inputs.size(), [&inputs]() {
+      for (Input &input : inputs) {
+        int count = 0;
+        input.state.EnumerateSolutions([&count](const std::array<uint8_t, 81> &) {
+          ++count;
+          return true;
+        });
+        DoNotOptimize(count);
+      }
+    });
+  }
+
+  // One operation is hashing the complete solution set of a single case.
+  if (IsSelected("HashSolutionSet")) {
+    RunBenchmark("HashSolutionSet", inputs.size(), [&inputs]() {
+      for (const Input &input : inputs) DoNotOptimize(HashSolutionSet(input.solutions));
+    });
+  }
+
+  // One operation is filtering the complete solution set by a single move.
+  if (IsSelected("FilterSolutions")) {
+    RunBenchmark("FilterSolutions", total_moves, [&inputs]() {
+      for (Input &input : inputs) {
+        for (const RankedMove &move : input.moves) {
+          DoNotOptimize(FilterSolutions(input.solutions, move.move).size());
+        }
+      }
+    });
+  }
+
+  // One operation is generating the ranked moves for a single case.
+  if (IsSelected("GenerateRankedMoves")) {
+    RunBenchmark("GenerateRankedMoves", inputs.size(), [&inputs]() {
+      for (Input &input : inputs) {
+        DoNotOptimize(GenerateRankedMoves(input.solutions, input.choice_positions).size());
+      }
+    });
+  }
+
+  // One operation is iterating over all ranked moves of a single case (in
+  // sorted order), including the cost of copying the moves, which is
+  // necessary since iteration reorders them.
+  if (IsSelected("SortingIterable")) {
+    std::vector<RankedMove> buffer;
+    RunBenchmark("SortingIterable", inputs.size(), [&inputs, &buffer]() {
+      for (const Input &input : inputs) {
+        buffer.assign(input.moves.begin(), input.moves.end());
+        int sum = 0;
+        for (const RankedMove &move : SortingIterable(std::span<RankedMove>(buffer))) {
+          sum += move.solution_count;
+        }
+        DoNotOptimize(sum);
+      }
+    });
+  }
+
+  // One operation is looking up a single random key (half of which are present).
+  if (IsSelected("LossyMemo::Lookup")) {
+    LossyMemo memo(arg_memo_size);
+    rng_t rng(12345);
+    std::vector<memo_key_t> keys(arg_memo_keys);
+    for (memo_key_t &key : keys) key = (uint64_t) rng() << 32 | rng();
+    for (size_t i = 0; i < keys.size(); i += 2) memo.Lookup(keys[i]).SetWinning(i % 4 == 0);
+    std::ranges::shuffle(keys, rng);
+    RunBenchmark("LossyMemo::Lookup", keys.size(), [&memo, &keys]() {
+      int hits = 0;
+      for (memo_key_t key : keys) hits += memo.Lookup(key).HasValue();
+      DoNotOptimize(hits);
+    });
+  }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (!ParseOptions(argc, argv) || arg_help) {
+    std::ostream &os = arg_help ? std::cout : std::clog;
+    os << "Usage: microbench [<options>]\n\nOptions:\n";
+    PrintOptionUsage(os);
+    return EXIT_FAILURE;
+  }
+
+  if (arg_memo_size <= 0 || (arg_memo_size & (arg_memo_size - 1)) != 0) {
+    std::cerr << "Memo size must be a power of 2!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<Input> inputs;
+  if (!LoadInputs(arg_cases, inputs)) return EXIT_FAILURE;
+
+  PerfCounters perf;
+  perf_counters = &perf;
+  if (!perf.Available()) {
+    std::cout << "Hardware performance counters are not available.\n";
+  }
+
+  RunBenchmarks(inputs);
+  return EXIT_SUCCESS;
+}
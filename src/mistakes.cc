@@ -0,0 +1,323 @@
+// Identifies provable mistakes in finished games.
+//
+// Reads games from competition results (the *-games.csv files in
+// competition-results/), player logs (the IO lines in playerlogs/), or
+// transcripts written by arbiter.py or the referee (one turn per line). For
+// each game that ended with a correct claim of a unique solution, positions
+// are analyzed from the end of the game backwards, until a position is too
+// large to enumerate or analyze. A move is a mistake if the player who made it
+// was winning before, and the opponent is winning after.
+//
+// Walking backwards means the small positions at the end of a game are solved
+// first, and their results are in the memo when the larger positions before
+// them are analyzed. Games are distributed over --jobs threads, which all share
+// a single memo, so positions that occur in multiple games are only solved
+// once. With --memo-shm, the memo is also shared with other processes (for
+// example, several runs over different sets of games).
+//
+// This replaces tools/identify-mistakes-from-competition.sh, which runs the
+// solver once per position, with a cold memo each time. Output has the same
+// format as data/test-2-mistakes.txt: one line per mistake, with tab-separated
+// fields game, 1-based turn, and user name. Games are printed in input order.
+
+#include "analysis.h"
+#include "memo.h"
+#include "options.h"
+#include "state.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+DECLARE_OPTION(bool, arg_help, false, "help",
+    "show usage information");
+
+DECLARE_OPTION(int, arg_jobs, std::max(1u, std::thread::hardware_concurrency()), "jobs",
+    "Number of games to analyze concurrently.");
+
+DECLARE_OPTION(int64_t, arg_memo_size, LossyMemo::default_size, "memo-size",
+    "Number of entries in the shared memo (must be a power of 2).");
+
+DECLARE_OPTION(std::string, arg_memo_shm, "", "memo-shm",
+    "If nonempty, the name of a POSIX shared memory object (e.g. /sudoku-memo) "
+    "that holds the memo, so that it is shared with other processes that use "
+    "the same name. It is created with --memo-size entries if it does not "
+    "exist yet.");
+
+DECLARE_OPTION(int, arg_enumerate_max_count, 1e6, "enumerate-max-count",
+    "Maximum number of solutions to enumerate per position.");
+
+DECLARE_OPTION(int64_t, arg_analyze_max_work, 1e9, "analyze-max-work",
+    "Work limit for analysis per position. When a position cannot be analyzed "
+    "within this limit, earlier mistakes in the game are not identified.");
+
+struct Game {
+  std::string id;
+  std::string users[2];
+  std::vector<std::string> turns;
+};
+
+struct GameResult {
+  std::string mistakes;  // output lines
+  std::string warning;   // printed to stderr, if not empty
+};
+
+std::string Basename(const std::string &path) {
+  size_t pos = path.rfind('/');
+  return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+std::vector<std::string> Split(const std::string &s, char sep) {
+  std::vector<std::string> parts;
+  std::istringstream iss(s);
+  for (std::string part; std::getline(iss, part, sep); ) parts.push_back(part);
+  return parts;
+}
+
+std::vector<std::string> SplitWords(const std::string &s) {
+  std::vector<std::string> words;
+  std::istringstream iss(s);
+  for (std::string word; iss >> word; ) words.push_back(word);
+  return words;
+}
+
+// Reads a competition results file with the columns: Game, Round, IsSwiss,
+// User1, Score1, Status1, User2, Score2, Status2, Moves, Solution. Like
+// tools/identify-mistakes-from-competition.sh, only games with a claim are
+// included.
+bool ReadCompetition(const std::string &filename, std::vector<Game> &games) {
+  std::ifstream is(filename);
+  if (!is) return false;
+  std::string line;
+  std::getline(is, line);  // header
+  while (std::getline(is, line)) {
+    if (line.find('!') == std::string::npos) continue;
+    std::vector<std::string> fields = Split(line, ',');
+    if (fields.size() < 10) return false;
+    games.push_back(Game{.id = fields[0], .users = {fields[3], fields[6]},
+        .turns = SplitWords(fields[9])});
+  }
+  return true;
+}
+
+// Reads a player log. Turns are taken from the "IO RCVD [...]" and "IO SEND
+// [...]" lines. The player is named after its ID line, and the game after the
+// file name (without the "game-" prefix and extension).
+bool ReadPlayerlog(const std::string &filename, const std::vector<std::string> &lines,
+    std::vector<Game> &games) {
+  Game game;
+  game.id = Basename(filename);
+  if (game.id.starts_with("game-")) game.id.erase(0, 5);
+  game.id = game.id.substr(0, game.id.rfind('.'));
+  std::string name = "player";
+  int me = -1;
+  for (const std::string &line : lines) {
+    if (line.starts_with("ID ")) name = line.substr(3, line.find(" (") - 3);
+    if (!line.starts_with("IO RCVD [") && !line.starts_with("IO SEND [")) continue;
+    size_t end = line.find(']');
+    if (end == std::string::npos) return false;
+    std::string s = line.substr(9, end - 9);
+    if (s == "Start") me = 0;
+    if (s == "Start" || s == "Quit") continue;
+    if (me < 0) me = 1;
+    game.turns.push_back(s);
+  }
+  if (me < 0) return false;
+  game.users[me] = name;
+  game.users[1 - me] = "opponent";
+  games.push_back(std::move(game));
+  return true;
+}
+
+// Reads a transcript written by arbiter.py or the referee. The game is named
+// after the file name (without the "-transcript.txt" suffix).
+void ReadTranscript(const std::string &filename, const std::vector<std::string> &lines,
+    std::vector<Game> &games) {
+  Game game = {.id = Basename(filename), .users = {"Player 1", "Player 2"}, .turns = {}};
+  if (game.id.ends_with("-transcript.txt")) game.id.resize(game.id.size() - 15);
+  for (const std::string &line : lines) {
+    std::vector<std::string> words = SplitWords(line);
+    if (words.empty()) continue;
+    // Invalid turns are copied to the transcript prefixed with "#".
+    game.turns.push_back(words[0] == "#" ? "#" : words[0]);
+  }
+  games.push_back(std::move(game));
+}
+
+bool ReadGames(const std::string &filename, std::vector<Game> &games) {
+  if (filename.ends_with(".csv")) return ReadCompetition(filename, games);
+  std::ifstream is(filename);
+  if (!is) return false;
+  std::vector<std::string> lines;
+  bool playerlog = false;
+  for (std::string line; std::getline(is, line); ) {
+    if (line.starts_with("IO ")) playerlog = true;
+    lines.push_back(std::move(line));
+  }
+  if (playerlog) return ReadPlayerlog(filename, lines, games);
+  ReadTranscript(filename, lines, games);
+  return true;
+}
+
+std::optional<Move> ParseMove(std::string_view s) {
+  if (s.size() != 3 ||
+      s[0] < 'A' || s[0] > 'I' ||
+      s[1] < 'a' || s[1] > 'i' ||
+      s[2] < '1' || s[2] > '9') return {};
+  return Move{.pos = 9*(s[0] - 'A') + (s[1] - 'a'), .digit = s[2] - '0'};
+}
+
+// Returns whether the player to move wins, or an empty optional if the
+// position could not be enumerated or analyzed within the limits.
+std::optional<bool> IsWinningPosition(AnalysisContext &context, State state) {
+  std::vector<solution_t> solutions;
+  EnumerateResult er = state.EnumerateSolutions(solutions, arg_enumerate_max_count);
+  if (!er.success || solutions.empty()) return {};
+  if (solutions.size() == 1) return true;  // unique solution can be claimed
+  grid_t givens = {};
+  for (int i = 0; i < 81; ++i) givens[i] = state.Digit(i);
+  AnalyzeResult result = Analyze(context, givens, solutions, 1, arg_analyze_max_work);
+  if (!result.outcome) return {};
+  return IsWinning(*result.outcome);
+}
+
+GameResult FindMistakes(AnalysisContext &context, const Game &game) {
+  GameResult result;
+  auto Warn = [&](const std::string &message) {
+    result.warning = "Game " + game.id + ": " + message;
+    return result;
+  };
+
+  // Replay the game. positions[i] is the position after i moves.
+  std::vector<State> positions(1);
+  bool claimed = false;
+  for (size_t i = 0; i < game.turns.size(); ++i) {
+    std::string_view s = game.turns[i];
+    if (s.ends_with('!')) {
+      if (i + 1 != game.turns.size()) return Warn("claim before the end of the game");
+      s.remove_suffix(1);
+      claimed = true;
+      if (s.empty()) break;
+    }
+    std::optional<Move> move = ParseMove(s);
+    if (!move) return Warn("invalid turn: " + game.turns[i]);
+    State state = positions.back();
+    if (!state.IsFree(move->pos) || !state.CanPlay(*move)) {
+      return Warn("invalid move: " + game.turns[i]);
+    }
+    state.Play(*move);
+    positions.push_back(state);
+  }
+  if (!claimed) return result;  // game did not end with a claim
+  if (positions.back().CountSolutions(2).count != 1) {
+    return Warn("transcript does not end with unique solution");
+  }
+
+  // Move t + 1 (played in positions[t]) is a mistake if both positions[t]
+  // and positions[t + 1] are winning for the player to move. Note that a
+  // losing position may be followed by another losing position, since moves
+  // that do not reduce the solution set are allowed in the competition.
+  //
+  // After the last move, the game is over if the player who made it claimed
+  // the unique solution, and otherwise the opponent claims it and wins.
+  const int move_count = positions.size() - 1;
+  bool next_winning = game.turns.back().size() == 1;
+  std::vector<int> mistakes;
+  for (int turn = move_count - 1; turn >= 0; --turn) {
+    std::optional<bool> win = IsWinningPosition(context, positions[turn]);
+    if (!win) break;  // analysis incomplete
+    if (*win && next_winning) mistakes.push_back(turn + 1);
+    next_winning = *win;
+  }
+
+  std::ostringstream oss;
+  for (auto it = mistakes.rbegin(); it != mistakes.rend(); ++it) {
+    int turn = *it;
+    oss << game.id << '\t' << turn << '\t' << game.users[(turn - 1) % 2] << '\n';
+  }
+  result.mistakes = oss.str();
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::vector<char *> plain_args;
+  if (!ParseOptions(argc, argv, plain_args) || plain_args.empty() || arg_help) {
+    std::ostream &os = arg_help ? std::cout : std::clog;
+    os << "Usage: mistakes [<options>] <games.csv|playerlog|transcript>...\n\n"
+          "Options:\n";
+    PrintOptionUsage(os);
+    return EXIT_FAILURE;
+  }
+
+  if (arg_memo_size <= 0 || (arg_memo_size & (arg_memo_size - 1)) != 0) {
+    std::cerr << "Memo size must be a power of 2!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<Game> games;
+  for (const char *filename : plain_args) {
+    if (!ReadGames(filename, games)) {
+      std::cerr << "Could not read games from " << filename << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::unique_ptr<memo_t> memo;
+  if (arg_memo_shm.empty()) {
+    memo = std::make_unique<memo_t>(arg_memo_size);
+  } else {
+    std::string error;
+    memo = LossyMemo::OpenShared(arg_memo_shm, arg_memo_size, error);
+    if (!memo) {
+      std::cerr << error << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  std::vector<std::optional<GameResult>> results(games.size());
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<size_t> next_game = 0;
+
+  auto worker = [&]() {
+    AnalysisContext context(*memo);
+    for (size_t i; (i = next_game++) < games.size(); ) {
+      GameResult result = FindMistakes(context, games[i]);
+      std::lock_guard<std::mutex> lock(mutex);
+      results[i] = std::move(result);
+      cv.notify_one();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < arg_jobs && (size_t) i < games.size(); ++i) threads.emplace_back(worker);
+
+  for (size_t i = 0; i < games.size(); ++i) {
+    GameResult result;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&results, i]() { return results[i].has_value(); });
+      result = std::move(*results[i]);
+      results[i].reset();
+    }
+    if (!result.warning.empty()) std::cerr << result.warning << std::endl;
+    std::cout << result.mistakes << std::flush;
+  }
+
+  for (std::thread &thread : threads) thread.join();
+  return EXIT_SUCCESS;
+}
@@ -4,6 +4,10 @@
 #include "logging.h"
 #include "random.h"
 #include "state.h"
+#include "stats.h"
+#include "strategy.h"
+#include "timer.h"
+#include "trace.h"
 
 #include <algorithm>
 #include <array>
@@ -12,6 +16,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <optional>
 #include <random>
 #include <sstream>
@@ -27,90 +32,109 @@ namespace {
 
 const std::string player_name = "Numberwang";
 
+constexpr StrategyParams default_params;
+
 DECLARE_OPTION(bool, arg_help, false, "help",
     "show usage information");
 
+DECLARE_OPTION(std::string, arg_trace_file, "", "trace-file",
+    "If not empty, write a trace of events to this file in Chrome trace format.");
+
+DECLARE_OPTION(bool, arg_collect_stats, false, "collect-stats",
+    "Collect statistics about the analysis search, and log them at the end of "
+    "the game.");
+
 DECLARE_OPTION(std::string, arg_seed, "", "seed",
     "Random seed in hexadecimal format. If empty, pick randomly. "
     "The chosen seed will be logged to stderr for reproducibility.");
 
-DECLARE_OPTION(int, arg_enumerate_min_clues, 8, "enumerate-min-clues",
+DECLARE_OPTION(int, arg_enumerate_min_clues, default_params.enumerate_min_clues, "enumerate-min-clues",
     "Minimum number of clues placed before enumerating solutions.");
 
-DECLARE_OPTION(int, arg_enumerate_max_count, 400'000, "enumerate-max-count",
+DECLARE_OPTION(int, arg_enumerate_max_count, default_params.enumerate_max_count, "enumerate-max-count",
     "Maximum number of solutions to enumerate.");
 
-DECLARE_OPTION(int64_t, arg_enumerate_max_work, 20'000'000, "enumerate-max-work",
+DECLARE_OPTION(int64_t, arg_enumerate_max_work, default_params.enumerate_max_work, "enumerate-max-work",
     "Maximum number of recursive calls used to enumerate solutions.");
 
-DECLARE_OPTION(int, arg_analyze_max_count, 100'000, "analyze-max-count",
+DECLARE_OPTION(int, arg_analyze_max_count, default_params.analyze_max_count, "analyze-max-count",
     "Maximum number of solutions to enable analysis. That is, endgame analysis "
     "does not start until the solution count is less than or equal to this value.");
 
-DECLARE_OPTION(int64_t, arg_analyze_max_work, 100'000'000, "analyze-max-work",
+DECLARE_OPTION(int64_t, arg_marginals_max_work, default_params.marginals_max_work, "marginals-max-work",
+    "Maximum number of recursive calls (plus memo counters stored, with "
+    "--marginals-by-bands) used to count solutions per cell and digit when there "
+    "are too many solutions to enumerate (or 0 to disable).");
+
+DECLARE_OPTION(bool, arg_marginals_by_bands, default_params.marginals_by_bands, "marginals-by-bands",
+    "Count solutions per cell and digit by band decomposition, which gives the "
+    "same counts but is often faster. Usually needs a higher "
+    "--marginals-max-work, such as 30 million.");
+
+DECLARE_OPTION(int64_t, arg_analyze_max_work, default_params.analyze_max_work, "analyze-max-work",
     "Maximum amount of work to perform during analysis (number of recursive calls "
     "times average number of solutions remaining). This only applies when no time "
     "limit is given.");
 
 DECLARE_OPTION(int, arg_time_limit, LOCAL_BUILD ? 0 : 28, "time-limit",
     "Time limit in seconds (or 0 to disable time-based performance). "
-    "On each turn, the player uses a fraction of time remaining on analysis. "
+    "On each turn, the player uses a fraction of time remaining, and aborts "
+    "enumeration and analysis when it runs out. "
     "Note that this should be slightly lower than the official time limit to "
     "account for overhead.");
 
-// Limit work done in a single call to Analyze(). This should be small enough
-// to avoid timeouts, but large enough to make analysis efficient.
+// Limit work done in a single call to Analyze(). The turn deadline aborts
+// analysis regardless of batch size, so this no longer needs to be small to
+// avoid timeouts, but it should be large enough to make analysis efficient.
 //
 // Before the move ordering implemented in commit 331998f, 10 million
 // corresponded with approximately 1 second on the CodeCup server, but this
 // might not be true anymore!
-DECLARE_OPTION(int64_t, arg_analyze_batch_size, 30'000'000, "analyze-batch-size",
+DECLARE_OPTION(int64_t, arg_analyze_batch_size, default_params.analyze_batch_size, "analyze-batch-size",
     "Amount of work to do at once when using a time limit.");
 
-
-// A simple timer. Can be running or paused. Tracks time both while running and
-// while paused. Use Elapsed() to query, Pause() and Resume() to switch states.
-class Timer {
-public:
-  Timer(bool running = true) : running(running) {}
-
-  bool Running() const { return running; }
-  bool Paused() const { return !running; }
-
-  // Returns how much time passed in the given state, in total.
-  log_duration_t Elapsed(bool while_running = true) {
-    clock_t::duration d = elapsed[while_running];
-    if (running == while_running) d += clock_t::now() - start;
-    return std::chrono::duration_cast<log_duration_t>(d);
-  }
-
-  log_duration_t Pause() {
-    assert(Running());
-    return TogglePause();
-  }
-
-  log_duration_t Resume() {
-    assert(Paused());
-    return TogglePause();
-  }
-
-  // Toggles running state, and returns how much time passed since last toggle.
-  log_duration_t TogglePause() {
-    auto end = clock_t::now();
-    auto delta = end - start;
-    elapsed[running] += delta;
-    start = end;
-    running = !running;
-    return std::chrono::duration_cast<log_duration_t>(delta);
-  }
-
-private:
-  using clock_t = std::chrono::steady_clock;
-
-  bool running = false;
-  clock_t::time_point start = clock_t::now();
-  clock_t::duration elapsed[2] = {clock_t::duration{0}, clock_t::duration{0}};
-};
+DECLARE_OPTION(int, arg_analyze_estimate_probes, default_params.analyze_estimate_probes, "analyze-estimate-probes",
+    "If positive, estimate the work of analysis with this many random probes "
+    "before starting, and skip analysis if the estimate exceeds the budget "
+    "(see --analyze-work-rate).");
+
+DECLARE_OPTION(int64_t, arg_analyze_work_rate, default_params.analyze_work_rate, "analyze-work-rate",
+    "Amount of analysis work per second, used to convert the time budget of a "
+    "turn into a work budget for --analyze-estimate-probes.");
+
+DECLARE_OPTION(bool, arg_async_log, false, "async-log",
+    "Write log lines to stderr in batches, once per turn after the move is "
+    "selected, so that logging doesn't make system calls while the turn is "
+    "timed (see StartAsyncLogging()).");
+
+DECLARE_OPTION(std::string, arg_memo_shm, "", "memo-shm",
+    "If nonempty, the name of a POSIX shared memory object (e.g. /sudoku-memo) "
+    "that holds the memo, so that players running concurrently on the same "
+    "machine share analysis results. It is created if it does not exist yet. "
+    "Sharing a memo between opponents couples their timings, so such games "
+    "cannot be used to compare two players.");
+
+DECLARE_OPTION(int, arg_canonical_memo_max_size, default_params.canonical_memo_max_size, "canonical-memo-max-size",
+    "If positive, also memoize positions with at most this many solutions "
+    "under a canonical key, which is shared by all isomorphic positions "
+    "(at most 64).");
+
+StrategyParams GetStrategyParams() {
+  StrategyParams params;
+  params.enumerate_min_clues = arg_enumerate_min_clues;
+  params.enumerate_max_count = arg_enumerate_max_count;
+  params.enumerate_max_work = arg_enumerate_max_work;
+  params.analyze_max_count = arg_analyze_max_count;
+  params.marginals_max_work = arg_marginals_max_work;
+  params.marginals_by_bands = arg_marginals_by_bands;
+  params.analyze_max_work = arg_analyze_max_work;
+  params.analyze_batch_size = arg_analyze_batch_size;
+  params.analyze_estimate_probes = arg_analyze_estimate_probes;
+  params.analyze_work_rate = arg_analyze_work_rate;
+  params.canonical_memo_max_size = arg_canonical_memo_max_size;
+  params.time_limit = std::chrono::seconds(arg_time_limit);
+  return params;
+}
 
 std::optional<Move> ParseMove(const std::string &s) {
   if (s.size() != 3 ||
@@ -131,6 +155,15 @@ std::string FormatTurn(const Turn &turn) {
   return oss.str();
 }
 
+// Statistics are logged only once per game, since they are cumulative.
+bool stats_logged = false;
+
+void LogStatsOnce() {
+  if (!collect_stats || stats_logged) return;
+  LogStats(CollectStats());
+  stats_logged = true;
+}
+
 std::string ReadInputLine() {
   std::string s;
   // I would rather do:
@@ -139,12 +172,15 @@ std::string ReadInputLine() {
   //
   // but the CodeCup judging system sometimes writes empty lines before the
   // actual input! See: https://forum.codecup.nl/read.php?31,2221
+  TraceScope trace("read input");
   if (!(std::cin >> s)) {
     LogError() << "Unexpected end of input!";
     exit(1);
   }
   LogReceived(s);
+  trace.Arg("line", s);
   if (s == "Quit") {
+    LogStatsOnce();
     LogInfo() << "Exiting.";
     exit(0);
   }
@@ -153,106 +189,20 @@ std::string ReadInputLine() {
 
 void WriteOutputLine(const std::string &s) {
   LogSending(s);
+  // Write queued log lines before the output line, since the referee may kill
+  // or suspend the process as soon as it receives the last move.
+  FlushAsyncLog();
   std::cout << s << std::endl;
 }
 
-Move PickRandomMove(const State &state, rng_t &rng) {
-  std::vector<Move> moves;
-  for (int pos = 0; pos < 81; ++pos) {
-    if (state.Digit(pos) == 0) {
-      unsigned unused = state.CellUnused(pos);
-      // Skip cells that are known to be unique. (Passing this check doesn't
-      // mean the move is valid, but it's not known to be invalid, which is
-      // better than nothing!)
-      if ((unused & (unused - 1)) == 0) continue;
-      for (int digit = 1; digit <= 9; ++digit) if (unused & (1u << digit)) {
-        moves.push_back(Move{.pos = pos, .digit = digit});
-      }
-    }
-  }
-  return RandomSample(moves, rng);
-}
-
-// Pick a move from an incomplete list of solutions.
-// It returns a random move that maximizes the number of solutions remaining.
-Move PickMoveIncomplete(const State &state, std::span<const solution_t> solutions, rng_t &rng) {
-  assert(!solutions.empty());
-  size_t count[81][10] = {};
-  for (const auto &solution : solutions) {
-    for (int i = 0; i < 81; ++i) {
-      ++count[i][solution[i]];
-    }
-  }
-
-  std::vector<Move> best_moves;
-#if MAXIMIZE_SOLUTIONS_REMAINING
-  size_t max_count = 0;
-#endif
-  for (int pos = 0; pos < 81; ++pos) {
-    if (state.Digit(pos) == 0) {
-      for (int digit = 1; digit <= 9; ++digit) {
-        size_t c = count[pos][digit];
-        assert(c <= solutions.size());
-        if (c == solutions.size()) continue;  // Must reduce solution set size!
-#if MAXIMIZE_SOLUTIONS_REMAINING
-        if (c > max_count) {
-          max_count = c;
-          best_moves.clear();
-        }
-        if (max_count > 0 && c == max_count) {
-          best_moves.push_back(Move{.pos = pos, .digit = digit});
-        }
-#else
-        if (c > 0) {
-          best_moves.push_back(Move{.pos = pos, .digit = digit});
-        }
-#endif
-      }
-    }
-  }
-#if MAXIMIZE_SOLUTIONS_REMAINING
-  assert(max_count > 0);
-#endif
-  assert(!best_moves.empty());
-  return RandomSample(best_moves, rng);
-}
-
-bool PlayGame(rng_t &rng) {
+bool PlayGame(rng_t &rng, memo_t *shared_memo) {
   std::string input = ReadInputLine();
   const int my_player = (input == "Start" ? 0 : 1);
 
   Timer total_timer;
+  int64_t pause_start = 0;
 
-  State state = {};
-  std::vector<solution_t> solutions = {};
-  bool solutions_complete = false;
-  bool winning = false;
-  size_t analyze_max_count = arg_analyze_max_count;
-
-  // Updates the game state and refines the solutions set after playing the given move.
-  auto PlayMove = [&state, &solutions, &solutions_complete](const Move &move) {
-    state.Play(move);
-
-    if (!solutions.empty()) {
-      if (!solutions_complete) {
-        // Just clear solutions. We'll regenerate them next turn.
-        solutions.clear();
-      } else {
-        // Narrow down set of solutions.
-        std::vector<solution_t> next_solutions;
-        for (const auto &solution : solutions) {
-          if (solution[move.pos] == move.digit) {
-            next_solutions.push_back(solution);
-          }
-        }
-        if (solutions.size() == next_solutions.size()) {
-          LogWarning() << "Non-reducing move: " << move;
-        }
-        solutions.swap(next_solutions);
-        assert(!solutions.empty());
-      }
-    }
-  };
+  Strategy strategy(GetStrategyParams(), true, shared_memo);
 
   for (int turn = 0;; ++turn) {
     if (turn % 2 == my_player) {
@@ -261,109 +211,57 @@ bool PlayGame(rng_t &rng) {
       // Print current state for debugging. Ideally I would print this every
       // turn, but the log output is getting close to CodeCup's 10,000 character
       // limit, so I only do it on my own player's turn.
-      LogTurn(turn, state, total_timer.Elapsed());
+      LogTurn(turn, strategy.GetState(), total_timer.Elapsed());
 
+      const int turn_index = turn;  // `turn` is shadowed below
+      const int64_t trace_turn_start = TraceEnabled() ? TraceNow() : 0;
       Timer turn_timer;
-      log_duration_t enumerate_time(0);
-      log_duration_t analyze_time(0);
-      if (!solutions_complete && turn >= arg_enumerate_min_clues) {
-        // Try to enumerate all solutions.
-        Timer timer;
-        EnumerateResult er = state.EnumerateSolutions(
-            solutions, arg_enumerate_max_count, arg_enumerate_max_work, &rng);
-        enumerate_time += timer.Elapsed();
-        if (er.Accurate()) {
-          solutions_complete = true;
-          if (solutions.empty()) {
-            LogError() << "No solutions remain!";
-            return false;
-          }
-        } else if (solutions.empty()) {
-          LogWarning() << "No solutions found! (this doesn't mean there aren't any)";
-        }
-      }
-      LogSolutions(solutions.size(), solutions_complete);
-
-      Turn turn;
-      if (solutions.empty()) {
-        // I don't know anything about solutions. Just pick randomly.
-        turn = Turn(PickRandomMove(state, rng));
-      } else if (!solutions_complete || solutions.size() > analyze_max_count) {
-        // I have some solutions but it's not the complete set.
-        turn = Turn(PickMoveIncomplete(state, solutions, rng));
-      } else {
-        // The hard case: select optimal move given the complete set of solutions.
-        Timer timer;
-        grid_t givens = {};
-        for (int i = 0; i < 81; ++i) givens[i] = state.Digit(i);
-        AnalyzeResult result;
-        if (arg_time_limit <= 0) {
-          result = Analyze(givens, solutions, 1, arg_analyze_max_work);
-        } else {
-          // Heuristic: each turn, use 1/3 of the remaining time for analysis.
-          // For a 30 second time limit this allocates: 10, 6.67, 4.44, 2.96, etc.
-          // Maybe TODO: make the fraction a command-line option?
-          log_duration_t
-            time_elapsed = total_timer.Elapsed(),
-            time_remaining = std::chrono::seconds(arg_time_limit) - time_elapsed,
-            time_budget = time_remaining / 3;
-          for (;;) {
-            result = Analyze(givens, solutions, 1, arg_analyze_batch_size);
-            if (result.outcome || timer.Elapsed() > time_budget) break;
-            LogInfo() << "Continuing analysis";
-          }
-        }
-        analyze_time += timer.Elapsed();
-        if (!result.outcome) {
-          LogWarning() << "Analysis aborted!";
-          // Fall back to pseudo-random selection.
-          turn = Turn(PickMoveIncomplete(state, solutions, rng));
-          // Reduce max_analyze so that we don't try to re-analyze until the
-          // solution set is smaller.
-          analyze_max_count = solutions.size() - 1;
-        } else {
-          turn = RandomSample(result.optimal_turns, rng);
-          LogOutcome(*result.outcome);
-          if (turn.claim_unique) LogInfo() << "That's Numberwang!";
-          // Detect bugs in analysis:
-          bool new_winning = IsWinning(*result.outcome);
-          if (winning && !new_winning) {
-            LogWarning() << "State went from winning to losing! "
-                << "(this means there is a bug in analysis)";
-          }
-          winning = new_winning;
-        }
-      }
+      TurnInfo info = strategy.SelectTurn(rng, total_timer.Elapsed());
+      const Turn &turn = info.turn;
+      if (turn.Empty()) return false;
+      const bool proven_losing = info.outcome && !IsWinning(*info.outcome);
 
       // Execute my selected move.
-      assert(!turn.Empty());
       for (int i = 0; i < turn.move_count; ++i) {
-        if (!state.CanPlay(turn.moves[i])) {
+        if (!strategy.GetState().CanPlay(turn.moves[i])) {
           LogError() << "Move " << i + 1 << " of " << turn.move_count << " is invalid!\n";
           return false;
         }
-        PlayMove(turn.moves[i]);
+        strategy.PlayMove(turn.moves[i]);
       }
-      LogTime(turn_timer.Elapsed(), enumerate_time, analyze_time);
+      LogTime(turn_timer.Elapsed(), info.enumerate_time, info.analyze_time);
+      // The referee doesn't send Quit after the last move, so log statistics
+      // when the game may be about to end: when claiming the win, or when the
+      // opponent is known to be winning. (In the latter case, the game may
+      // still continue for several turns, but statistics are not logged again.)
+      if (turn.claim_unique || proven_losing) LogStatsOnce();
       // Note: we should pause the timer just before writing the output line,
       // since the referee may suspend our process immediately after.
       total_timer.Pause();
       WriteOutputLine(FormatTurn(turn));
+      if (TraceEnabled()) {
+        // Record the time we are paused as a separate event, and write the
+        // trace now, while the extra latency doesn't count against our time.
+        TraceComplete("turn", trace_turn_start, "\"turn\":" + std::to_string(turn_index));
+        pause_start = TraceNow();
+        FlushTrace();
+      }
     } else {
       // Opponent's turn.
       if (turn > 0) {
         input = ReadInputLine();
         auto pause_duration = total_timer.Resume();
+        if (TraceEnabled()) TraceComplete("paused", pause_start);
         LogPause(pause_duration, total_timer.Elapsed(false));
       }
       if (auto m = ParseMove(input); !m) {
         LogError() << "Could not parse move!";
         return false;
-      } else if (!state.CanPlay(*m)) {
+      } else if (!strategy.GetState().CanPlay(*m)) {
         LogError() << "Invalid move received!";
         return false;
       } else {
-        PlayMove(*m);
+        strategy.PlayMove(*m);
       }
     }
   }
@@ -400,11 +298,30 @@ int main(int argc, char *argv[]) {
     return EXIT_FAILURE;
   }
 
+  if (arg_canonical_memo_max_size < 0 || arg_canonical_memo_max_size > max_canonical_memo_size) {
+    LogError() << "Canonical memo max size must be between 0 and " << max_canonical_memo_size;
+    return EXIT_FAILURE;
+  }
+
+  collect_stats = arg_collect_stats;
+  if (!StartTracing(player_name, arg_trace_file)) return EXIT_FAILURE;
+  if (arg_async_log) StartAsyncLogging();
+
   // Initialize RNG.
   rng_seed_t seed;
   if (!InitializeSeed(seed, arg_seed)) return EXIT_FAILURE;
   LogSeed(seed);
   rng_t rng = CreateRng(seed);
 
-  return PlayGame(rng) ? EXIT_SUCCESS : EXIT_FAILURE;
+  std::unique_ptr<memo_t> shared_memo;
+  if (!arg_memo_shm.empty()) {
+    std::string error;
+    shared_memo = LossyMemo::OpenShared(arg_memo_shm, default_params.memo_size, error);
+    if (!shared_memo) {
+      LogError() << error;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return PlayGame(rng, shared_memo.get()) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
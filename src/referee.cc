@@ -0,0 +1,640 @@
+// Native replacement for arbiter.py.
+//
+// Plays games between player commands with the same protocol, rules, output
+// tables and log files as arbiter.py, but validates moves with
+// State::CountSolutions() instead of running a SAT solver for every check, and
+// runs many games concurrently on a single thread, with an epoll loop over the
+// players' output pipes and process file descriptors.
+//
+// Unlike arbiter.py, which measures the wall time spent waiting for each
+// reply, the reported times are the CPU time (user + system) used by each
+// player process over the whole game, which is what CodeCup limits. This makes
+// the results independent of the number of games run in parallel.
+//
+// Example:
+//
+//   referee --rounds=10 --parallel=4 output/release/player "./random-player.py"
+
+#include "arena.h"
+#include "options.h"
+#include "state.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+DECLARE_OPTION(bool, arg_help, false, "help",
+    "show usage information");
+
+DECLARE_OPTION(int, arg_rounds, 0, "rounds",
+    "Number of full rounds to play (or 0 for a single game between each pair "
+    "of players).");
+
+DECLARE_OPTION(std::string, arg_logdir, "", "logdir",
+    "Directory where to write player logs.");
+
+DECLARE_OPTION(bool, arg_fast, false, "fast",
+    "Increase speed by disabling checking for unsolvable grids. Unlike "
+    "arbiter.py, a move that repeats a digit in its row, column or box still "
+    "ends the game as unsolvable.");
+
+DECLARE_OPTION(int, arg_parallel, 1, "parallel",
+    "Number of games to run concurrently (no more than physical cores!)");
+
+DECLARE_OPTION(int, arg_time_limit, 0, "time-limit",
+    "CPU time limit per player per game in seconds (or 0 for no limit). "
+    "Players that exceed it are killed, which counts as a failure.");
+
+const char *const roles[2] = {"First", "Second"};
+
+std::optional<Move> ParseMove(std::string_view s) {
+  if (s.size() != 3 ||
+      s[0] < 'A' || s[0] > 'I' ||
+      s[1] < 'a' || s[1] > 'i' ||
+      s[2] < '1' || s[2] > '9') return {};
+  return Move{.pos = 9*(s[0] - 'A') + (s[1] - 'a'), .digit = s[2] - '0'};
+}
+
+// Same as ParseTurn() in arbiter.py, with MAX_MOVES = 1.
+std::optional<Turn> ParseTurn(std::string_view s) {
+  if (s.ends_with('!')) {
+    if (s.size() == 1) return Turn(true);
+    if (s.size() != 4) return {};
+  } else if (s.size() != 3) {
+    return {};
+  }
+  std::optional<Move> move = ParseMove(s.substr(0, 3));
+  if (!move) return {};
+  return Turn(*move, s.size() == 4);
+}
+
+std::string_view Strip(std::string_view s) {
+  while (!s.empty() && isspace((unsigned char) s.front())) s.remove_prefix(1);
+  while (!s.empty() && isspace((unsigned char) s.back())) s.remove_suffix(1);
+  return s;
+}
+
+struct Game;
+
+// Identifies the file descriptor that an epoll event belongs to.
+struct Source {
+  Game *game;
+  int player;
+  bool exit;  // process file descriptor rather than standard output
+};
+
+struct Player {
+  pid_t pid = -1;
+  int pidfd = -1;
+  int in = -1;   // write end of the player's standard input
+  int out = -1;  // read end of the player's standard output
+  std::string buffer;  // output read but not yet processed
+  bool eof = false;
+  bool exited = false;
+  int status = 0;  // like Popen.returncode: negative signal number if killed
+  double cpu_time = 0;
+};
+
+struct Game {
+  int index;
+  int player_index[2];
+  Player players[2];
+  Source sources[2][2];
+  std::ofstream transcript;
+  State state;
+  int turn_id = 0;
+  int solution_count = 2;
+  bool over = false;
+  bool finished = false;
+  GameOutcome outcomes[2] = {GameOutcome::LOSS, GameOutcome::LOSS};
+};
+
+int epoll_fd = -1;
+
+void Watch(int fd, Source *source) {
+  epoll_event event = {.events = EPOLLIN, .data = {.ptr = source}};
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+    std::cerr << "epoll_ctl(): " << strerror(errno) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+void Close(int &fd) {
+  if (fd < 0) return;
+  // Closing a file descriptor removes it from the epoll set.
+  close(fd);
+  fd = -1;
+}
+
+// Starts `sh -c command` with pipes for standard input and output, and
+// standard error redirected to the log file (if any).
+void Launch(const std::string &command, const std::string &logfile, Player &player) {
+  int in[2], out[2];
+  if (pipe2(in, O_CLOEXEC) != 0 || pipe2(out, O_CLOEXEC) != 0) {
+    std::cerr << "pipe2(): " << strerror(errno) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  int err = open(logfile.empty() ? "/dev/null" : logfile.c_str(),
+      O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (err < 0) {
+    std::cerr << "Could not open " << logfile << ": " << strerror(errno) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork(): " << strerror(errno) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    // dup2() clears the close-on-exec flag on the new descriptors.
+    dup2(in[0], STDIN_FILENO);
+    dup2(out[1], STDOUT_FILENO);
+    dup2(err, STDERR_FILENO);
+    signal(SIGPIPE, SIG_DFL);
+    if (arg_time_limit > 0) {
+      rlimit limit = {.rlim_cur = (rlim_t) arg_time_limit, .rlim_max = (rlim_t) arg_time_limit + 1};
+      setrlimit(RLIMIT_CPU, &limit);
+    }
+    execl("/bin/sh", "sh", "-c", command.c_str(), (char *) nullptr);
+    _exit(127);
+  }
+  close(in[0]);
+  close(out[1]);
+  close(err);
+  fcntl(out[0], F_SETFL, O_NONBLOCK);
+  player.pid = pid;
+  player.in = in[1];
+  player.out = out[0];
+  player.pidfd = syscall(SYS_pidfd_open, pid, 0);
+  if (player.pidfd < 0) {
+    std::cerr << "pidfd_open(): " << strerror(errno) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Writes a line to the player's standard input. Returns false if the player
+// closed it (the equivalent of BrokenPipeError in arbiter.py).
+bool Send(Player &player, std::string line) {
+  if (player.in < 0) return false;
+  line += '\n';
+  for (size_t pos = 0; pos < line.size(); ) {
+    ssize_t n = write(player.in, line.data() + pos, line.size() - pos);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    pos += n;
+  }
+  return true;
+}
+
+std::string FormatTurn(const Turn &turn) {
+  std::ostringstream oss;
+  oss << turn;
+  return oss.str();
+}
+
+// Assigns the outcome to the player whose turn it is, and a win to the other.
+void Fail(Game &game, GameOutcome outcome) {
+  game.outcomes[game.turn_id % 2] = outcome;
+  game.outcomes[1 - game.turn_id % 2] = GameOutcome::WIN;
+}
+
+// Gracefully quits both players. The game finishes when both have exited.
+void EndGame(Game &game) {
+  game.over = true;
+  for (Player &player : game.players) {
+    if (!player.exited) Send(player, "Quit");
+    Close(player.in);
+  }
+  if (game.transcript.is_open()) game.transcript.close();
+}
+
+// Validates and executes a turn, like the loop body in RunGame() in
+// arbiter.py. Afterwards, either the game is over, or the next player has
+// been sent the turn.
+void PlayTurn(Game &game, std::string_view line) {
+  std::optional<Turn> turn = ParseTurn(line);
+  if (!turn) {
+    Fail(game, GameOutcome::FAIL);
+    if (game.transcript.is_open()) game.transcript << "# " << line << '\n';
+    EndGame(game);
+    return;
+  }
+
+  std::optional<GameOutcome> failure;
+  for (const Move &move : turn->Moves()) {
+    if (!game.state.IsFree(move.pos)) {
+      failure = GameOutcome::FAIL;
+      break;
+    }
+    if (!arg_fast && !IsReducing(game.state, move)) {
+      failure = GameOutcome::NONREDUCE;
+      break;
+    }
+    // Also checked with --fast (unlike in arbiter.py, which keeps playing on
+    // an invalid grid until a claim fails), since State can't represent it.
+    if (!game.state.CanPlay(move)) {
+      failure = GameOutcome::UNSOLVABLE;
+      break;
+    }
+    game.state.Play(move);
+    if (!arg_fast) {
+      game.solution_count = game.state.HasSolution() ? game.state.CountSolutions(2).count : 0;
+      if (game.solution_count == 0) {
+        failure = GameOutcome::UNSOLVABLE;
+        break;
+      }
+    }
+  }
+
+  if (game.transcript.is_open()) game.transcript << *turn << '\n';
+
+  if (failure) {
+    Fail(game, *failure);
+    EndGame(game);
+    return;
+  }
+
+  if (turn->claim_unique) {
+    if (arg_fast) game.solution_count = game.state.CountSolutions(2).count;
+    if (game.solution_count == 1) {
+      game.outcomes[game.turn_id % 2] = GameOutcome::WIN;
+    } else {
+      Fail(game, GameOutcome::FAIL);
+    }
+    EndGame(game);
+    return;
+  }
+
+  if (++game.turn_id == 81) {
+    EndGame(game);
+    return;
+  }
+  if (!Send(game.players[game.turn_id % 2], FormatTurn(*turn))) {
+    Fail(game, GameOutcome::FAIL);
+    EndGame(game);
+  }
+}
+
+// Processes complete lines of output from the player whose turn it is. At the
+// end of its output, the remainder is processed as the last line, just like
+// readline() in arbiter.py (so a player that exits without replying fails).
+void Advance(Game &game) {
+  while (!game.over) {
+    Player &player = game.players[game.turn_id % 2];
+    size_t newline = player.buffer.find('\n');
+    if (newline == std::string::npos && !player.eof) return;
+    std::string line = player.buffer.substr(0, newline);
+    player.buffer.erase(0, newline == std::string::npos ? newline : newline + 1);
+    PlayTurn(game, Strip(line));
+  }
+}
+
+void HandleOutput(Game &game, int p) {
+  Player &player = game.players[p];
+  if (player.out < 0) return;
+  char buffer[4096];
+  for (;;) {
+    ssize_t n = read(player.out, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && errno == EAGAIN) break;
+    if (n <= 0) {
+      player.eof = true;
+      Close(player.out);
+      break;
+    }
+    // Output after the end of the game is discarded, like arbiter.py does.
+    if (!game.over) player.buffer.append(buffer, n);
+  }
+  Advance(game);
+}
+
+void HandleExit(Game &game, int p) {
+  Player &player = game.players[p];
+  if (player.exited) return;
+  int status = 0;
+  rusage usage = {};
+  pid_t pid;
+  do pid = wait4(player.pid, &status, WNOHANG, &usage); while (pid < 0 && errno == EINTR);
+  if (pid != player.pid) return;
+  player.exited = true;
+  player.status = WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status);
+  player.cpu_time =
+      usage.ru_utime.tv_sec + usage.ru_utime.tv_usec*1e-6 +
+      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec*1e-6;
+  Close(player.pidfd);
+}
+
+// Returns true if the game just finished.
+bool MaybeFinish(Game &game, const std::vector<std::string> &commands) {
+  if (game.finished || !game.over ||
+      !game.players[0].exited || !game.players[1].exited) return false;
+  game.finished = true;
+  for (int i = 0; i < 2; ++i) {
+    Player &player = game.players[i];
+    Close(player.out);
+    if (player.status != 0) {
+      std::cerr << roles[i] << " command exited with nonzero status " << player.status
+          << ": " << commands[game.player_index[i]] << std::endl;
+      game.outcomes[i] = GameOutcome::FAIL;
+    }
+  }
+  return true;
+}
+
+// Writes output to standard output and optionally to a file, like the Tee
+// class in arbiter.py.
+void Print(std::ostream *file, const std::string &line) {
+  std::cout << line << '\n';
+  if (file) *file << line << '\n';
+}
+
+std::string JoinPath(const std::string &dir, const std::string &name) {
+  return dir.empty() ? name : dir + "/" + name;
+}
+
+std::string Basename(const std::string &path) {
+  size_t pos = path.rfind('/');
+  return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+// Same as MakeLogfilenames() in arbiter.py: transcript, first and second
+// player's log file.
+std::array<std::string, 3> MakeLogfilenames(
+    const std::string &logdir, const std::string &name1, const std::string &name2,
+    int game_index, int game_count) {
+  if (logdir.empty()) return {};
+  std::string prefix = name1 + "-vs-" + name2;
+  if (game_count > 1) {
+    prefix = "game-" + std::to_string(game_index + 1) + "-of-" +
+        std::to_string(game_count) + "-" + prefix;
+  }
+  return {JoinPath(logdir, prefix + "-transcript.txt"),
+          JoinPath(logdir, prefix + "-first.txt"),
+          JoinPath(logdir, prefix + "-second.txt")};
+}
+
+// Same as DeduplicateNames() in arbiter.py.
+std::vector<std::string> DeduplicateNames(const std::vector<std::string> &names) {
+  std::map<std::string, int> name_count, name_index;
+  for (const std::string &name : names) ++name_count[name];
+  std::vector<std::string> unique_names;
+  for (const std::string &name : names) {
+    if (name_count[name] == 1) {
+      unique_names.push_back(name);
+    } else {
+      unique_names.push_back(name + "-" + std::to_string(++name_index[name]));
+    }
+  }
+  return unique_names;
+}
+
+// Same as MakeLogdir() in arbiter.py. Returns an empty optional on failure.
+std::optional<std::string> MakeLogdir(const std::string &logdir, int rounds) {
+  if (logdir.empty()) return logdir;
+  struct stat st;
+  if (stat(logdir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+    std::cerr << "Not a directory: " << logdir << std::endl;
+    return {};
+  }
+  if (rounds == 0) return logdir;
+  // Create a subdirectory based on current date & time
+  char dirname[32];
+  time_t now = time(nullptr);
+  strftime(dirname, sizeof(dirname), "%Y%m%dT%H%M%S", localtime(&now));
+  std::string subdir = JoinPath(logdir, dirname);
+  if (mkdir(subdir.c_str(), 0777) != 0) {
+    std::cerr << "Could not create " << subdir << ": " << strerror(errno) << std::endl;
+    return {};
+  }
+  return subdir;
+}
+
+struct PlayerStats {
+  double time_total = 0;
+  double time_max = 0;
+  std::map<GameOutcome, int> outcomes;
+};
+
+int RunGames(
+    const std::vector<std::string> &commands, const std::vector<std::string> &names,
+    int rounds, const std::string &logdir) {
+  const int P = commands.size();
+
+  std::vector<std::pair<int, int>> pairings;
+  if (rounds == 0) {
+    // Play only one match between every pair of players, regardless of order
+    for (int i = 0; i < P; ++i) for (int j = i + 1; j < P; ++j) pairings.push_back({i, j});
+  } else {
+    // Play one match per round between every pair of players and each order
+    for (int r = 0; r < rounds; ++r) {
+      for (int i = 0; i < P; ++i) for (int j = 0; j < P; ++j) if (i != j) pairings.push_back({i, j});
+    }
+  }
+  const int game_count = pairings.size();
+
+  int games_per_player = 0;
+  for (auto [i, j] : pairings) games_per_player += (i == 0) + (j == 0);
+
+  const bool symlink_playerlogs = !logdir.empty() && game_count > 1;
+
+  if (!logdir.empty()) {
+    std::cout << "Writing logs to directory " << logdir << "\n\n";
+  }
+
+  std::vector<std::string> playerlog_dirs;
+  if (symlink_playerlogs) {
+    for (const std::string &name : names) {
+      std::string dirname = JoinPath(logdir, name + "-logs");
+      if (mkdir(dirname.c_str(), 0777) != 0) {
+        std::cerr << "Could not create " << dirname << ": " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+      }
+      playerlog_dirs.push_back(dirname);
+    }
+  }
+
+  std::ofstream results_file;
+  if (!logdir.empty() && game_count > 1) results_file.open(JoinPath(logdir, "results.txt"));
+  std::ostream *f = results_file.is_open() ? &results_file : nullptr;
+
+  const char *const results_rule =
+      "---- ------------------ ------------------ ---------- ---------- ------ ------";
+  Print(f, "Game Player 1           Player 2           Outcome 1  Outcome 2  Time 1 Time 2");
+  Print(f, results_rule);
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) {
+    std::cerr << "epoll_create1(): " << strerror(errno) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::unique_ptr<Game>> games;
+  auto StartGame = [&](int game_index) {
+    auto [i, j] = pairings[game_index];
+    auto [transcript, logfile1, logfile2] =
+        MakeLogfilenames(logdir, names[i], names[j], game_index, game_count);
+    if (symlink_playerlogs) {
+      symlink(("../" + Basename(logfile1)).c_str(),
+          JoinPath(playerlog_dirs[i], Basename(logfile1)).c_str());
+      symlink(("../" + Basename(logfile2)).c_str(),
+          JoinPath(playerlog_dirs[j], Basename(logfile2)).c_str());
+    }
+
+    Game &game = *games.emplace_back(new Game);
+    game.index = game_index;
+    game.player_index[0] = i;
+    game.player_index[1] = j;
+    if (!transcript.empty()) game.transcript.open(transcript);
+    Launch(commands[i], logfile1, game.players[0]);
+    Launch(commands[j], logfile2, game.players[1]);
+    for (int p = 0; p < 2; ++p) {
+      game.sources[p][0] = Source{.game = &game, .player = p, .exit = false};
+      game.sources[p][1] = Source{.game = &game, .player = p, .exit = true};
+      Watch(game.players[p].out, &game.sources[p][0]);
+      Watch(game.players[p].pidfd, &game.sources[p][1]);
+    }
+    if (!Send(game.players[0], "Start")) {
+      Fail(game, GameOutcome::FAIL);
+      EndGame(game);
+    }
+  };
+
+  std::vector<PlayerStats> stats(P);
+  int started = 0;
+  int printed = 0;
+  while (started < std::min(std::max(arg_parallel, 1), game_count)) StartGame(started++);
+  while (printed < game_count) {
+    epoll_event events[64];
+    int n = epoll_wait(epoll_fd, events, std::size(events), -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      std::cerr << "epoll_wait(): " << strerror(errno) << std::endl;
+      return EXIT_FAILURE;
+    }
+    for (int k = 0; k < n; ++k) {
+      const Source &source = *(const Source *) events[k].data.ptr;
+      Game &game = *source.game;
+      if (source.exit) {
+        HandleExit(game, source.player);
+      } else {
+        HandleOutput(game, source.player);
+      }
+      if (MaybeFinish(game, commands) && started < game_count) StartGame(started++);
+    }
+
+    // Print results in the order the games were started, like arbiter.py.
+    while (printed < game_count && printed < (int) games.size() && games[printed]->finished) {
+      Game &game = *games[printed++];
+      auto [i, j] = pairings[game.index];
+      double times[2] = {game.players[0].cpu_time, game.players[1].cpu_time};
+      for (int p = 0; p < 2; ++p) {
+        PlayerStats &s = stats[game.player_index[p]];
+        s.time_total += times[p];
+        s.time_max = std::max(s.time_max, times[p]);
+        ++s.outcomes[game.outcomes[p]];
+      }
+      std::ostringstream oss;
+      oss << std::setw(4) << game.index + 1 << ' ' << std::left
+          << std::setw(18) << names[i] << ' ' << std::setw(18) << names[j] << ' '
+          << std::setw(10) << game.outcomes[0] << ' ' << std::setw(10) << game.outcomes[1] << ' '
+          << std::right << std::fixed << std::setprecision(2)
+          << std::setw(6) << times[0] << ' ' << std::setw(6) << times[1];
+      Print(f, oss.str());
+      std::cout.flush();
+      games[game.index].reset();
+    }
+  }
+  Print(f, results_rule);
+  results_file.close();
+
+  // Print summary of players.
+  if (game_count > 1) {
+    std::cout << '\n';
+    std::ofstream summary_file;
+    if (!logdir.empty()) summary_file.open(JoinPath(logdir, "summary.txt"));
+    std::ostream *f = summary_file.is_open() ? &summary_file : nullptr;
+    const char *const summary_rule =
+        "------------------ ------ ------ ---- ---- ---- ---- ---- ----";
+    Print(f, "Player             Avg.Tm Max.Tm Wins Loss Unsl Nonr Fail Tot.");
+    Print(f, summary_rule);
+    std::vector<int> order(P);
+    for (int p = 0; p < P; ++p) order[p] = p;
+    std::stable_sort(order.begin(), order.end(), [&](int p, int q) {
+      return stats[p].outcomes[GameOutcome::WIN] > stats[q].outcomes[GameOutcome::WIN];
+    });
+    for (int p : order) {
+      PlayerStats &s = stats[p];
+      std::ostringstream oss;
+      oss << std::left << std::setw(18) << names[p] << std::right
+          << std::fixed << std::setprecision(2)
+          << ' ' << std::setw(6) << s.time_total / games_per_player
+          << ' ' << std::setw(6) << s.time_max;
+      for (GameOutcome o : {GameOutcome::WIN, GameOutcome::LOSS, GameOutcome::UNSOLVABLE,
+                            GameOutcome::NONREDUCE, GameOutcome::FAIL}) {
+        oss << ' ' << std::setw(4) << s.outcomes[o];
+      }
+      oss << ' ' << std::setw(4) << games_per_player;
+      Print(f, oss.str());
+    }
+    Print(f, summary_rule);
+  }
+
+  if (!logdir.empty()) {
+    std::cout << "\nLogs written to directory " << logdir << '\n';
+  }
+  return EXIT_SUCCESS;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::vector<char*> plain_args;
+  if (!ParseOptions(argc, argv, plain_args) || arg_help || plain_args.size() < 2 ||
+      arg_rounds < 0) {
+    std::ostream &os = arg_help ? std::cout : std::clog;
+    os << "Usage: referee [<options>] <command1> <command2> [<commandN>...]\n\nOptions:\n";
+    PrintOptionUsage(os);
+    return EXIT_FAILURE;
+  }
+
+  std::optional<std::string> logdir = MakeLogdir(arg_logdir, arg_rounds);
+  if (!logdir) return EXIT_FAILURE;
+
+  std::vector<std::string> commands(plain_args.begin(), plain_args.end());
+  std::vector<std::string> names;
+  for (const std::string &command : commands) {
+    // Approximates os.path.basename(shlex.split(command)[0]) in arbiter.py.
+    std::string_view s = Strip(command);
+    names.push_back(Basename(std::string(s.substr(0, s.find_first_of(" \t")))));
+  }
+  names = DeduplicateNames(names);
+
+  // Writing to a player that has exited fails with EPIPE instead.
+  signal(SIGPIPE, SIG_IGN);
+  return RunGames(commands, names, arg_rounds, *logdir);
+}
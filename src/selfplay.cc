@@ -0,0 +1,189 @@
+// Plays games between two strategies in-process (see arena.h).
+//
+// Games are played in pairs with the same random seed, where the players
+// switch sides in the second game of each pair. Each game is written to the
+// log on a single line (see PrintGameRecord() for the format), and a summary
+// similar to the one printed by arbiter.py is written to standard output.
+//
+// Example:
+//
+//   selfplay --player1=default --player2=heuristic --games=100 --log=games.txt
+
+#include "arena.h"
+#include "options.h"
+#include "random.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+DECLARE_OPTION(bool, arg_help, false, "help",
+    "show usage information");
+
+DECLARE_OPTION(std::string, arg_player1, "default", "player1",
+    "Specification of the first player (see arena.h for the syntax).");
+
+DECLARE_OPTION(std::string, arg_player2, "heuristic", "player2",
+    "Specification of the second player.");
+
+DECLARE_OPTION(int, arg_games, 100, "games",
+    "Number of games to play. Should be even, since games are played in pairs.");
+
+DECLARE_OPTION(int, arg_jobs, std::max(1u, std::thread::hardware_concurrency()), "jobs",
+    "Number of games to play in parallel.");
+
+DECLARE_OPTION(std::string, arg_seed, "", "seed",
+    "Random seed in hexadecimal format. If empty, pick randomly.");
+
+// The default is much smaller than the player's, since there are two players
+// per game, and multiple games running in parallel. It can be overridden per
+// player with the memo-size key.
+DECLARE_OPTION(int64_t, arg_memo_size, 1 << 22, "memo-size",
+    "Default number of memo entries per player (must be a power of 2).");
+
+DECLARE_OPTION(std::string, arg_log, "", "log",
+    "File to write game records to (or - for standard output).");
+
+struct PlayerSummary {
+  int outcomes[5] = {};
+  std::chrono::nanoseconds total_time{0};
+  std::chrono::nanoseconds max_time{0};
+};
+
+void PrintSummary(std::ostream &os, const PlayerConfig configs[2],
+    const PlayerSummary summaries[2], int games) {
+  using seconds_t = std::chrono::duration<double>;
+  os << "Player                         Avg.Tm Max.Tm Wins Loss Unsl Nonr Fail Tot.\n"
+        "------------------------------ ------ ------ ---- ---- ---- ---- ---- ----\n";
+  for (int i = 0; i < 2; ++i) {
+    const PlayerSummary &s = summaries[i];
+    os << std::left << std::setw(30) << configs[i].name.substr(0, 30) << std::right
+        << std::fixed << std::setprecision(2)
+        << ' ' << std::setw(6) << seconds_t(s.total_time).count() / std::max(games, 1)
+        << ' ' << std::setw(6) << seconds_t(s.max_time).count();
+    for (int n : s.outcomes) os << ' ' << std::setw(4) << n;
+    os << ' ' << std::setw(4) << games << '\n';
+  }
+  os << "------------------------------ ------ ------ ---- ---- ---- ---- ---- ----\n";
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (!ParseOptions(argc, argv) || arg_help) {
+    std::ostream &os = arg_help ? std::cout : std::clog;
+    os << "Usage: selfplay [<options>]\n\nOptions:\n";
+    PrintOptionUsage(os);
+    return EXIT_FAILURE;
+  }
+
+  if (arg_memo_size <= 0 || (arg_memo_size & (arg_memo_size - 1)) != 0) {
+    std::cerr << "Memo size must be a power of 2!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  StrategyParams base_params;
+  base_params.memo_size = arg_memo_size;
+
+  PlayerConfig configs[2];
+  for (int i = 0; i < 2; ++i) {
+    const std::string &spec = i == 0 ? arg_player1 : arg_player2;
+    auto config = ParsePlayerConfig(spec, base_params);
+    if (!config) {
+      std::cerr << "Invalid player specification: [" << spec << "]" << std::endl;
+      return EXIT_FAILURE;
+    }
+    configs[i] = *config;
+  }
+
+  rng_seed_t seed;
+  if (arg_seed.empty()) {
+    seed = GenerateSeed(4);
+  } else if (auto s = ParseSeed(arg_seed)) {
+    seed = *s;
+  } else {
+    std::cerr << "Could not parse RNG seed: [" << arg_seed << "]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "Seed: " << FormatSeed(seed) << std::endl;
+
+  std::ofstream log_file;
+  std::ostream *log = nullptr;
+  if (arg_log == "-") {
+    log = &std::cout;
+  } else if (!arg_log.empty()) {
+    log_file.open(arg_log);
+    if (!log_file) {
+      std::cerr << "Could not open log file: " << arg_log << std::endl;
+      return EXIT_FAILURE;
+    }
+    log = &log_file;
+  }
+
+  const size_t games = std::max(arg_games, 0);
+  std::vector<std::optional<GameRecord>> records(games);
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<size_t> next_game = 0;
+
+  // Game i is played with the seed followed by i/2; in odd games, the second
+  // player moves first.
+  auto worker = [&]() {
+    for (size_t i; (i = next_game++) < games; ) {
+      rng_seed_t game_seed = seed;
+      game_seed.push_back(i / 2);
+      const PlayerConfig *players[2] = {&configs[i % 2], &configs[1 - i % 2]};
+      GameRecord record = SimulateGame(players, game_seed);
+      std::lock_guard<std::mutex> lock(mutex);
+      records[i] = std::move(record);
+      cv.notify_one();
+    }
+  };
+
+  auto start_time = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < arg_jobs && (size_t) i < games; ++i) threads.emplace_back(worker);
+
+  PlayerSummary summaries[2];
+  for (size_t i = 0; i < games; ++i) {
+    GameRecord record;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&records, i]() { return records[i].has_value(); });
+      record = std::move(*records[i]);
+      records[i].reset();
+    }
+    for (int j = 0; j < 2; ++j) {
+      // configs[k] played as player j in this game.
+      int k = (i % 2) ^ j;
+      PlayerSummary &s = summaries[k];
+      s.outcomes[(int) record.outcomes[j]]++;
+      s.total_time += record.cpu_time[j];
+      s.max_time = std::max(s.max_time, record.cpu_time[j]);
+    }
+    if (log) {
+      *log << i + 1 << '\t' << configs[i % 2].name << '\t' << configs[1 - i % 2].name << '\t';
+      PrintGameRecord(*log, record);
+      *log << std::endl;
+    }
+  }
+  for (std::thread &thread : threads) thread.join();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+  std::cout << '\n';
+  PrintSummary(std::cout, configs, summaries, games);
+  std::cout << '\n' << games << " games in " << std::fixed << std::setprecision(3)
+      << elapsed.count() << " s (" << games / elapsed.count() << " games/s)" << std::endl;
+  return EXIT_SUCCESS;
+}
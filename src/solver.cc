@@ -1,18 +1,32 @@
 #include "analysis.h"
+#include "bands.h"
 #include "counters.h"
 #include "options.h"
 #include "state.h"
+#include "stats.h"
+#include "trace.h"
+#include "zdd.h"
+
+#include <sys/resource.h>
 
 #include <array>
+#include <atomic>
 #include <bit>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
 #include <cstring>
 #include <cctype>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <span>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace {
@@ -21,6 +35,31 @@ DECLARE_OPTION(bool, arg_help,       false, "help",
     "show usage information");
 DECLARE_OPTION(bool, arg_count_only, false, "count-only",
     "only count solutions");
+DECLARE_OPTION(bool, arg_marginals, false, "marginals",
+    "count solutions per cell and digit without enumerating them");
+DECLARE_OPTION(bool, arg_bands, false, "bands",
+    "count solutions per cell and digit by band decomposition");
+DECLARE_OPTION(std::string, arg_trace_file, "", "trace-file",
+    "if not empty, write a trace of events to this file in Chrome trace format");
+DECLARE_OPTION(bool, arg_collect_stats, false, "collect-stats",
+    "collect statistics about the analysis search, and print them to stderr");
+DECLARE_OPTION(int,  arg_jobs,       0,     "jobs",
+    "if positive, process states from standard input in batch mode using this "
+    "many threads, printing one line of tab-separated results per state");
+
+DECLARE_OPTION(int64_t, memo_size, LossyMemo::default_size, "memo-size",
+    "number of memo entries (per thread, unless --memo-shm is given); must "
+    "be a power of 2");
+DECLARE_OPTION(std::string, memo_shm, "", "memo-shm",
+    "if nonempty, the name of a POSIX shared memory object (e.g. /sudoku-memo) "
+    "that holds a memo shared by all threads, and by other processes that use "
+    "the same name; it is created with --memo-size entries if it does not "
+    "exist yet (see LossyMemo::OpenShared())");
+
+DECLARE_OPTION(int, canonical_memo_max_size, 0, "canonical-memo-max-size",
+    "if positive, also memoize positions with at most this many solutions "
+    "under a canonical key, which is shared by all isomorphic positions "
+    "(at most 64)");
 
 DECLARE_OPTION(int64_t, analyze_max_work,        1e18, "analyze-max-work",
     "work limit for analysis");
@@ -32,6 +71,24 @@ DECLARE_OPTION(int,     max_print,                100, "max-print",
     "max. number of solutions to print");
 DECLARE_OPTION(int,     max_winning_moves,          1, "max-winning-moves",
     "max. number of winning moves to list");
+DECLARE_OPTION(std::string, engine,          "list", "engine",
+    "analysis engine: \"list\" (explicit lists of solutions) or \"zdd\" "
+    "(decision diagrams, see zdd.h)");
+DECLARE_OPTION(int64_t, zdd_max_nodes,            1e8, "zdd-max-nodes",
+    "max. number of ZDD nodes when building and analyzing solution sets (with "
+    "--engine=zdd)");
+DECLARE_OPTION(int,     estimate_probes,            0, "estimate-probes",
+    "if positive, estimate analysis work with this many random probes before "
+    "analyzing (see EstimateAnalysisWork())");
+
+// Memo shared by all analysis contexts, if --memo-shm was given.
+memo_t *shared_memo = nullptr;
+
+AnalysisContext CreateContext() {
+  AnalysisContext context = shared_memo ? AnalysisContext(*shared_memo) : AnalysisContext(memo_size);
+  context.canonical_memo_max_size = canonical_memo_max_size;
+  return context;
+}
 
 char Char(int d, char zero='.') {
   assert(d >= 0 && d < 10);
@@ -115,6 +172,27 @@ void CountSolutions(State &state) {
 #endif
 }
 
+void CountMarginals(State &state, bool bands) {
+  auto start_time = std::chrono::steady_clock::now();
+  Marginals marginals;
+  EnumerateResult er = bands ? CountMarginalsByBands(state, marginals) : state.CountMarginals(marginals);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+  assert(er.Accurate());
+  std::cout << marginals.total << " solutions (" << (bands ? "bands" : "marginals") << ")\n";
+  std::cout << "Work required: " << er.work << '\n';
+  std::cout << "Time required: " << elapsed.count() << " s\n";
+  if (marginals.total == 0) return;
+  // Print the counts for each cell in which more than one digit is possible.
+  for (int i = 0; i < 81; ++i) {
+    if (marginals.count[i][state.Digit(i)] == marginals.total) continue;
+    std::cout << (char) ('A' + i / 9) << (char) ('a' + i % 9);
+    for (int d = 1; d <= 9; ++d) {
+      if (marginals.count[i][d]) std::cout << ' ' << d << ':' << marginals.count[i][d];
+    }
+    std::cout << '\n';
+  }
+}
+
 bool Determined(unsigned mask) { return (mask & (mask - 1)) == 0; }
 
 int GetSingleDigit(unsigned mask) {
@@ -132,12 +210,92 @@ candidates_t CalculateOptions(std::span<const solution_t> solutions) {
   return options;
 }
 
-void EnumerateSolutions(State &state) {
+// Runs analysis in batches of at most analyze_batch_size until it completes,
+// or until analyze_max_work is exhausted. The work field of the result is the
+// total over all batches.
+AnalyzeResult AnalyzeInBatches(
+    AnalysisContext &context, const grid_t &givens,
+    std::span<const solution_t> solutions, bool verbose) {
+  AnalyzeResult result;
+  int64_t total_work = 0;
+  int64_t work_left = analyze_max_work;
+  for (;;) {
+    int64_t max_work = std::min(work_left, analyze_batch_size);
+    result = Analyze(context, givens, solutions, max_winning_moves, max_work);
+    total_work += result.work;
+    if (result.outcome) break;
+    work_left -= max_work;
+    if (work_left == 0) break;
+    if (verbose) std::cout << "Analysis continuing..." << std::endl;
+  }
+  result.work = total_work;
+  return result;
+}
+
+// Returns the peak resident set size of the process in bytes.
+int64_t PeakMemoryUsage() {
+  rusage usage = {};
+  getrusage(RUSAGE_SELF, &usage);
+  return (int64_t) usage.ru_maxrss * 1024;
+}
+
+void PrintZdd(const Zdd &zdd) {
+  std::cout << zdd.NodeCount() << " ZDD nodes, using " << zdd.MemoryUsage() << " bytes" << std::endl;
+}
+
+// Analyzes the state with the ZDD engine, without listing solutions.
+void AnalyzeWithZdd(State &state) {
+  Zdd zdd;
+  std::optional<Zdd::node_t> root;
+  {
+    TraceScope trace("build zdd");
+    auto start_time = std::chrono::steady_clock::now();
+    root = BuildSolutionZdd(zdd, state, zdd_max_nodes);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    std::cout << "Time required to build ZDD: " << elapsed.count() << " s\n";
+    trace.Arg("nodes", zdd.NodeCount());
+  }
+  PrintZdd(zdd);
+  if (!root) {
+    std::cout << "ZDD node limit reached!\n";
+    return;
+  }
+  const uint64_t count = zdd.Count(*root);
+  std::cout << count << " solutions" << std::endl;
+
+  if (count == 0) {
+    std::cout << "No solution possible!\n";
+  } else if (count == 1) {
+    std::cout << "Solution is unique!\n";
+  } else {
+    ZddAnalyzer analyzer(zdd, zdd_max_nodes);
+    AnalyzeResult result = analyzer.Analyze(*root, max_winning_moves, analyze_max_work);
+    if (!result.outcome) {
+      std::cout << "Analysis incomplete!" << std::endl;
+    } else {
+      std::cout << "Outcome: " << *result.outcome << '\n';
+      std::cout << result.optimal_turns.size() << " optimal turns:";
+      for (const Turn &turn : result.optimal_turns) std::cout << ' ' << turn;
+      std::cout << '\n';
+    }
+    std::cout << "Work required: " << result.work << '\n';
+    PrintZdd(zdd);
+    std::cout << '\n' << counters << '\n';
+  }
+  std::cout << "Peak memory: " << PeakMemoryUsage() << " bytes\n";
+}
+
+void EnumerateSolutions(AnalysisContext &context, State &state) {
   grid_t givens = {};
   for (int i = 0; i < 81; ++i) givens[i] = state.Digit(i);
 
   std::vector<solution_t> solutions;
-  EnumerateResult er = state.EnumerateSolutions(solutions, enumerate_max_count);
+  EnumerateResult er;
+  {
+    TraceScope trace("enumerate");
+    er = state.EnumerateSolutions(solutions, enumerate_max_count);
+    trace.Arg("solutions", solutions.size());
+  }
 
   // Print solutions
   size_t print_count = std::min(solutions.size(), (size_t) max_print);
@@ -252,16 +410,12 @@ void EnumerateSolutions(State &state) {
   } else if (solutions.size() == 1) {
     std::cout << "Solution is unique!\n";
   } else {
-    AnalyzeResult result;
-    int64_t work_left = analyze_max_work;
-    for (;;) {
-      int64_t max_work = std::min(work_left, analyze_batch_size);
-      result = Analyze(givens, solutions, max_winning_moves, max_work);
-      if (result.outcome) break;
-      work_left -= max_work;
-      if (work_left == 0) break;
-      std::cout << "Analysis continuing..." << std::endl;
+    if (estimate_probes > 0) {
+      rng_t rng;
+      std::cout << "Estimated work: "
+          << EstimateAnalysisWork(context, givens, solutions, estimate_probes, rng) << std::endl;
     }
+    AnalyzeResult result = AnalyzeInBatches(context, givens, solutions, true);
     if (!result.outcome) {
       std::cout << "Analysis incomplete!" << std::endl;
     } else {
@@ -271,13 +425,161 @@ void EnumerateSolutions(State &state) {
       std::cout << '\n';
     }
     std::cout << '\n' << counters << '\n';
+    if (collect_stats) {
+      std::cout << '\n';
+      PrintStats(std::cout, CollectStats());
+    }
   }
+  std::cout << "Peak memory: " << PeakMemoryUsage() << " bytes\n";
 }
 
-void Process(State &state) {
+void Process(AnalysisContext &context, State &state) {
+  TraceScope trace("case");
   CountSolutions(state);
+  if (arg_marginals) CountMarginals(state, false);
+  if (arg_bands) CountMarginals(state, true);
 
-  if (!arg_count_only) EnumerateSolutions(state);
+  if (arg_count_only) return;
+  if (engine == "zdd") {
+    AnalyzeWithZdd(state);
+  } else {
+    EnumerateSolutions(context, state);
+  }
+}
+
+// Processes a single line in batch mode. Returns the tab-separated fields
+// described in the usage text (except for the line number).
+std::string ProcessBatchLine(AnalysisContext &context, const std::string &line) {
+  TraceScope trace("case");
+  trace.Arg("state", line);
+  auto start_time = std::chrono::steady_clock::now();
+  const int64_t start_recursive_calls = counters.recursive_calls.CurValue();
+  const int64_t start_memo_accessed   = counters.memo_accessed.CurValue();
+  const int64_t start_memo_returned   = counters.memo_returned.CurValue();
+
+  std::string outcome;
+  std::string solution_count = "-";
+  std::vector<Turn> turns;
+  int64_t work = 0;
+  int64_t estimated_work = 0;
+  if (auto state = ParseDesc(line.c_str()); !state) {
+    outcome = "INVALID";
+  } else if (engine == "zdd") {
+    Zdd zdd;
+    std::optional<Zdd::node_t> root;
+    {
+      TraceScope trace("build zdd");
+      root = BuildSolutionZdd(zdd, *state, zdd_max_nodes);
+      trace.Arg("nodes", zdd.NodeCount());
+    }
+    if (!root) {
+      outcome = "UNKNOWN";
+    } else if (*root == Zdd::empty) {
+      outcome = "NONE";
+      solution_count = "0";
+    } else {
+      solution_count = std::to_string(zdd.Count(*root));
+      AnalyzeResult result = ZddAnalyzer(zdd, zdd_max_nodes).Analyze(*root, max_winning_moves, analyze_max_work);
+      work = result.work;
+      if (!result.outcome) {
+        outcome = "UNKNOWN";
+      } else {
+        std::ostringstream oss;
+        oss << *result.outcome;
+        outcome = oss.str();
+        turns = std::move(result.optimal_turns);
+      }
+    }
+  } else {
+    grid_t givens = {};
+    for (int i = 0; i < 81; ++i) givens[i] = state->Digit(i);
+
+    std::vector<solution_t> solutions;
+    EnumerateResult er;
+    {
+      TraceScope trace("enumerate");
+      er = state->EnumerateSolutions(solutions, enumerate_max_count);
+      trace.Arg("solutions", solutions.size());
+    }
+    solution_count = std::to_string(solutions.size());
+    if (!er.success) {
+      solution_count += '+';
+      outcome = "UNKNOWN";
+    } else if (solutions.empty()) {
+      outcome = "NONE";
+    } else {
+      if (estimate_probes > 0) {
+        rng_t rng;
+        estimated_work = EstimateAnalysisWork(context, givens, solutions, estimate_probes, rng);
+      }
+      AnalyzeResult result = AnalyzeInBatches(context, givens, solutions, false);
+      work = result.work;
+      if (!result.outcome) {
+        outcome = "UNKNOWN";
+      } else {
+        std::ostringstream oss;
+        oss << *result.outcome;
+        outcome = oss.str();
+        turns = std::move(result.optimal_turns);
+      }
+    }
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+  std::ostringstream oss;
+  oss << outcome << '\t' << solution_count << '\t';
+  if (turns.empty()) oss << '-';
+  for (size_t i = 0; i < turns.size(); ++i) {
+    if (i > 0) oss << ' ';
+    oss << turns[i];
+  }
+  oss << '\t' << work << '\t' << std::fixed << std::setprecision(3) << elapsed.count()
+      << '\t' << counters.recursive_calls.CurValue() - start_recursive_calls
+      << '\t' << counters.memo_accessed.CurValue() - start_memo_accessed
+      << '\t' << counters.memo_returned.CurValue() - start_memo_returned;
+  if (estimate_probes > 0) oss << '\t' << estimated_work;
+  return oss.str();
+}
+
+// Processes all lines from standard input using `jobs` worker threads, each
+// with its own analysis context. Results are printed in input order.
+void ProcessBatch(int jobs) {
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(std::cin, line); ) lines.push_back(std::move(line));
+
+  std::vector<std::optional<std::string>> results(lines.size());
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<size_t> next_line = 0;
+
+  auto worker = [&]() {
+    AnalysisContext context = CreateContext();
+    for (size_t i; (i = next_line++) < lines.size(); ) {
+      std::string result = ProcessBatchLine(context, lines[i]);
+      std::lock_guard<std::mutex> lock(mutex);
+      results[i] = std::move(result);
+      cv.notify_one();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < jobs && (size_t) i < lines.size(); ++i) threads.emplace_back(worker);
+
+  for (size_t i = 0; i < lines.size(); ++i) {
+    std::string result;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&results, i]() { return results[i].has_value(); });
+      result = std::move(*results[i]);
+      results[i].reset();
+    }
+    std::cout << i + 1 << '\t' << result << std::endl;
+  }
+
+  for (std::thread &thread : threads) thread.join();
+
+  if (collect_stats) PrintStats(std::cerr, CollectStats());
 }
 
 }  // namespace
@@ -288,13 +590,74 @@ int main(int argc, char *argv[]) {
     std::ostream &os = arg_help ? std::cout : std::clog;
     os << "Usage:\n"
         "\tsolver [<options>] <state>  (solves a single state)\n"
-        "\tsolver [<options>] -        (solve states read from standard input)\n\n"
+        "\tsolver [<options>] -        (solve states read from standard input)\n"
+        "\tsolver --jobs=N [<options>] -  (batch mode; see below)\n\n"
         "Options:\n";
     PrintOptionUsage(os);
+    os << "\n"
+        "In batch mode, each output line contains the following tab-separated fields:\n"
+        "\t1. line number (1-based)\n"
+        "\t2. outcome: LOSS, WIN1 or WIN2, or UNKNOWN if the solutions could not be\n"
+        "\t   enumerated or analysis did not complete, NONE if there are no\n"
+        "\t   solutions, or INVALID if the line could not be parsed\n"
+        "\t3. solution count (with a '+' suffix if enumeration was incomplete)\n"
+        "\t4. optimal turns, separated by spaces (or '-' if unknown)\n"
+        "\t5. analysis work\n"
+        "\t6. elapsed time in seconds\n"
+        "\t7. recursive calls (search nodes)\n"
+        "\t8. memo lookups\n"
+        "\t9. memo hits\n"
+        "\t10. estimated analysis work (only with --estimate-probes)\n";
+    return EXIT_FAILURE;
+  }
+
+  if (memo_size <= 0 || (memo_size & (memo_size - 1)) != 0) {
+    std::cerr << "Memo size must be a power of 2!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (canonical_memo_max_size < 0 || canonical_memo_max_size > max_canonical_memo_size) {
+    std::cerr << "Canonical memo max size must be between 0 and "
+        << max_canonical_memo_size << "!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (zdd_max_nodes < 0 || (uint64_t) zdd_max_nodes > Zdd::max_node_count) {
+    std::cerr << "ZDD max nodes must be between 0 and "
+        << Zdd::max_node_count << "!" << std::endl;
     return EXIT_FAILURE;
   }
 
+  std::unique_ptr<LossyMemo> shm_memo;
+  if (!memo_shm.empty()) {
+    std::string error;
+    shm_memo = LossyMemo::OpenShared(memo_shm, memo_size, error);
+    if (!shm_memo) {
+      std::cerr << error << std::endl;
+      return EXIT_FAILURE;
+    }
+    shared_memo = shm_memo.get();
+  }
+
+  if (engine != "list" && engine != "zdd") {
+    std::cerr << "Unknown engine: " << engine << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  collect_stats = arg_collect_stats;
+  if (!StartTracing("solver", arg_trace_file)) return EXIT_FAILURE;
+
   const char *arg = plain_args[0];
+  if (arg_jobs > 0) {
+    if (strcmp(arg, "-") != 0) {
+      std::cerr << "Batch mode requires reading from standard input (-)" << std::endl;
+      return EXIT_FAILURE;
+    }
+    ProcessBatch(arg_jobs);
+    return EXIT_SUCCESS;
+  }
+
+  AnalysisContext context = CreateContext();
   if (strcmp(arg, "-") != 0) {
     // Process the state description passed as a command line argument.
     auto state = ParseDesc(arg);
@@ -302,7 +665,7 @@ int main(int argc, char *argv[]) {
       std::cerr << "Could parse command line argument: [" << arg << "]\n";
       return EXIT_FAILURE;
     }
-    Process(*state);
+    Process(context, *state);
   } else {
     // Process each line read from standard input.
     std::string line;
@@ -312,7 +675,7 @@ int main(int argc, char *argv[]) {
         std::cerr << "Parse error on line " << line_no << ": [" << line << "]\n";
         return 1;
       }
-      Process(*state);
+      Process(context, *state);
     }
   }
 }
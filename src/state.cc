@@ -42,6 +42,73 @@ void State::DebugPrint(std::ostream &os) const {
   os << '\n';
 }
 
+// Cells of each row, column and box.
+static const std::array<std::array<uint8_t, 9>, 27> unit_cells = []() {
+  std::array<std::array<uint8_t, 9>, 27> units;
+  for (int i = 0; i < 81; ++i) {
+    units[Row(i)][Col(i)] = i;
+    units[9 + Col(i)][Row(i)] = i;
+    units[18 + Box(i)][3*(Row(i) % 3) + Col(i) % 3] = i;
+  }
+  return units;
+}();
+
+bool State::HasSolution() {
+  // Find the most constrained cell.
+  int best_count = 10;
+  int best_cell = -1;
+  for (int i = 0; i < 81; ++i) {
+    if (digit[i] != 0) continue;
+    unsigned unused = CellUnused(i);
+    if (unused == 0) return false;
+    if (std::popcount(unused) < best_count) {
+      best_count = std::popcount(unused);
+      best_cell = i;
+    }
+  }
+  if (best_cell < 0) return true;  // Solution found!
+
+  // Find the most constrained digit in a row, column or box.
+  int best_unit = -1;
+  int best_digit = 0;
+  if (best_count > 1) {
+    for (int u = 0; u < 27; ++u) {
+      unsigned unit_unused = u < 9 ? unused_row[u] : u < 18 ? unused_col[u - 9] : unused_box[u - 18];
+      for (unsigned m = unit_unused; m; m &= m - 1) {
+        int d = std::countr_zero(m);
+        int count = 0;
+        for (int i : unit_cells[u]) count += digit[i] == 0 && (CellUnused(i) & (1u << d));
+        if (count == 0) return false;
+        if (count < best_count) {
+          best_count = count;
+          best_unit = u;
+          best_digit = d;
+        }
+      }
+    }
+  }
+
+  if (best_unit < 0) {
+    for (unsigned m = CellUnused(best_cell); m; m &= m - 1) {
+      Move move = {.pos = best_cell, .digit = std::countr_zero(m)};
+      Play(move);
+      bool result = HasSolution();
+      Undo(move);
+      if (result) return true;
+    }
+  } else {
+    for (int i : unit_cells[best_unit]) {
+      if (digit[i] != 0 || (CellUnused(i) & (1u << best_digit)) == 0) continue;
+      Move move = {.pos = i, .digit = best_digit};
+      Play(move);
+      bool result = HasSolution();
+      Undo(move);
+      if (result) return true;
+    }
+  }
+  return false;
+}
+
 // Note: the logic here is very similar to EnumerateSolutionsImpl(), except
 // that this version never actually fills in any digits.
 void State::CountSolutions(std::span<Position> todo, CountState &cs) {
@@ -92,10 +159,128 @@ void State::CountSolutions(std::span<Position> todo, CountState &cs) {
   }
 }
 
+// The number of solutions in each subtree is added to the counts of the
+// digit chosen at the root of the subtree. Since the digits of all other cells
+// are counted in their own subtrees, no work is needed at the leaves.
+int64_t State::CountMarginals(std::span<Position> todo, MarginalsState &ms) {
+  if (todo.empty()) return 1;  // Solution found!
+
+  if (ms.deadline && ms.deadline->Poll(todo.size())) {
+    ms.work_left = 0;
+    return 0;
+  }
+
+  // Find most constrained cell to fill in.
+  int min_unused_count = 10;
+  int min_unused_index = -1;
+  unsigned min_unused_mask = 0;
+  for (int j = 0; j < (int) todo.size(); ++j) {
+    auto [i, r, c, b] = todo[j];
+    unsigned unused = unused_row[r] & unused_col[c] & unused_box[b];
+    if (unused == 0) return 0;  // unsolvable
+    int unused_count = std::popcount(unused);
+    if (unused_count < min_unused_count) {
+      min_unused_index = j;
+      min_unused_count = unused_count;
+      min_unused_mask = unused;
+    }
+  }
+  std::swap(todo[min_unused_index], todo.back());
+
+  auto [i, r, c, b] = todo.back();
+  std::span<Position> remaining(todo.begin(), todo.end() - 1);
+
+  Marginals &m = ms.marginals;
+  const int pair_index = ms.pair_index[i];
+  const int pair_cells = m.pair_cells.size();
+
+  // Try all possible digits.
+  int64_t total = 0;
+  unsigned unused = min_unused_mask;
+  while (unused && ms.work_left) {
+    --ms.work_left;
+
+    int d = std::countr_zero(unused);
+    unsigned mask = 1u << d;
+    unused ^= mask;
+
+    digit[i] = d;
+    unused_row[r] ^= mask;
+    unused_col[c] ^= mask;
+    unused_box[b] ^= mask;
+
+    int64_t n = CountMarginals(remaining, ms);
+
+    unused_row[r] ^= mask;
+    unused_col[c] ^= mask;
+    unused_box[b] ^= mask;
+    digit[i] = 0;
+
+    if (n == 0) continue;
+    total += n;
+    m.count[i][d] += n;
+    if (pair_index >= 0) {
+      // Pairs with cells that were filled in before this one. Pairs with cells
+      // that are filled in later are counted in the subtree.
+      for (int k = 0; k < pair_cells; ++k) {
+        int e = digit[m.pair_cells[k]];
+        if (e == 0) continue;
+        m.pair_count[((pair_index*pair_cells + k)*10 + d)*10 + e] += n;
+        m.pair_count[((k*pair_cells + pair_index)*10 + e)*10 + d] += n;
+      }
+    }
+  }
+  return total;
+}
+
+EnumerateResult State::CountMarginals(
+    Marginals &marginals, int64_t max_work, Deadline *deadline) {
+  assert(max_work >= 0);
+  const int pair_cells = marginals.pair_cells.size();
+  assert(pair_cells <= 81);
+  marginals.total = 0;
+  std::fill(&marginals.count[0][0], &marginals.count[0][0] + 81*10, 0);
+  marginals.pair_count.assign(pair_cells*pair_cells*10*10, 0);
+
+  MarginalsState ms = {
+    .marginals = marginals, .work_left = max_work, .deadline = deadline, .pair_index = {}};
+  std::fill(std::begin(ms.pair_index), std::end(ms.pair_index), -1);
+  for (int j = 0; j < pair_cells; ++j) ms.pair_index[marginals.pair_cells[j]] = j;
+
+  std::array<Position, 81> buf;
+  std::span<Position> todo = GetEmptyPositions(buf);
+  int64_t total = CountMarginals(todo, ms);
+  marginals.total = total;
+
+  // Givens occur in every solution.
+  for (int i = 0; i < 81; ++i) {
+    if (digit[i] != 0) marginals.count[i][digit[i]] = total;
+  }
+  for (int j = 0; j < pair_cells; ++j) {
+    // Pairs of a cell with itself are equal to the single-cell counts.
+    for (int d = 1; d <= 9; ++d) {
+      marginals.pair_count[((j*pair_cells + j)*10 + d)*10 + d] =
+          marginals.count[marginals.pair_cells[j]][d];
+    }
+    int dj = digit[marginals.pair_cells[j]];
+    if (dj == 0) continue;
+    for (int k = 0; k < pair_cells; ++k) {
+      int dk = digit[marginals.pair_cells[k]];
+      if (dk == 0 || k == j) continue;
+      marginals.pair_count[((j*pair_cells + k)*10 + dj)*10 + dk] = total;
+    }
+  }
+
+  return EnumerateResult{
+    .success = true,
+    .work = max_work - ms.work_left,
+    .max_work = max_work};
+}
+
 EnumerateResult State::EnumerateSolutions(
     std::vector<std::array<uint8_t, 81>> &solutions,
     int max_count, int64_t max_work,
-    rng_t *rng) {
+    rng_t *rng, Deadline *deadline) {
   assert(max_count >= 0);
   solutions.clear();
   return EnumerateSolutions(
@@ -104,7 +289,8 @@ EnumerateResult State::EnumerateSolutions(
       return solutions.size() < (size_t) max_count;
     },
     max_work,
-    rng);
+    rng,
+    deadline);
 }
 
 // This is currently unused!
@@ -1,6 +1,7 @@
 #ifndef STATE_H_INCLUDED
 #define STATE_H_INCLUDED
 
+#include "deadline.h"
 #include "random.h"
 
 #include <algorithm>
@@ -34,7 +35,7 @@ struct Move {
 // moves and claim that the solution is unique, which ends the game.
 struct Turn {
   bool claim_unique;
-  int move_count;
+  int move_count = 0;
   Move moves[1];
 
   Turn(const Turn &t) = default;
@@ -81,6 +82,30 @@ struct EnumerateResult {
   bool WorkLimitReached() const { return work >= max_work; }
 };
 
+// Number of solutions per cell and digit ("marginals"), which is calculated by
+// State::CountMarginals() without storing the solutions themselves.
+struct Marginals {
+  // Total number of solutions.
+  int64_t total = 0;
+
+  // count[i][d] is the number of solutions with digit d in cell i.
+  int64_t count[81][10] = {};
+
+  // Optionally, pairwise counts can be calculated for a few selected cells,
+  // by setting pair_cells before calling CountMarginals(). This is expensive
+  // for many cells, since the cost grows quadratically with their number.
+  std::vector<int> pair_cells;
+
+  // Returns the number of solutions with digit dj in cell pair_cells[j] and
+  // digit dk in cell pair_cells[k].
+  int64_t PairCount(int j, int k, int dj, int dk) const {
+    return pair_count[((j*pair_cells.size() + k)*10 + dj)*10 + dk];
+  }
+
+  // Used by CountMarginals(). Indexed by [j][k][dj][dk], as in PairCount().
+  std::vector<int64_t> pair_count;
+};
+
 class State {
 
 public:
@@ -113,7 +138,7 @@ public:
   void Undo(const Move &m) {
     assert(digit[m.pos] == m.digit);
     digit[m.pos] = 0;
-    unsigned mask = ~(1u << m.digit);
+    unsigned mask = 1u << m.digit;
     unused_row[Row(m.pos)] ^= mask;
     unused_col[Col(m.pos)] ^= mask;
     unused_box[Box(m.pos)] ^= mask;
@@ -151,24 +176,34 @@ public:
       .max_work = max_work};
   }
 
+  // Returns whether the grid has at least one solution. Unlike
+  // CountSolutions(1), this also branches on the cells where a digit can go in
+  // a row, column or box, when that is more constrained than any single cell,
+  // which makes it much faster to prove that a sparse grid is unsolvable.
+  bool HasSolution();
+
   // Enumerates up to `max_count` solutions and stores them in the given vector.
   // (The vector is cleared at the start.)
+  //
+  // If a deadline is given, enumeration stops when it expires, and the result
+  // is reported as if the work limit was reached.
   EnumerateResult EnumerateSolutions(
     std::vector<std::array<uint8_t, 81>> &solutions,
     int max_count = 1e9, int64_t max_work = 1e18,
-    rng_t *rng = nullptr);
+    rng_t *rng = nullptr, Deadline *deadline = nullptr);
 
   // Enumerates solutions and invokes callback(digits) until it returns false,
   // or until work_left is 0. Returns `false` if the callback ever returned
   // false, or true otherwise.
   template<typename Callback>
   EnumerateResult EnumerateSolutions(
-      const Callback &callback, int64_t max_work = 1e18, rng_t *rng = nullptr) {
+      const Callback &callback, int64_t max_work = 1e18, rng_t *rng = nullptr,
+      Deadline *deadline = nullptr) {
     std::array<Position, 81> buf;
     std::span<Position> todo = GetEmptyPositions(buf);
     if (rng) std::shuffle(todo.begin(), todo.end(), *rng);
     int64_t work_left = max_work;
-    bool success = EnumerateSolutionsImpl(callback, todo, work_left);
+    bool success = EnumerateSolutionsImpl(callback, todo, work_left, deadline);
     assert(work_left >= 0);
     return EnumerateResult{
       .success = success,
@@ -176,6 +211,16 @@ public:
       .max_work = max_work};
   }
 
+  // Counts solutions per cell and digit (see Marginals above). This visits the
+  // same search tree as EnumerateSolutions(), but since solutions are not
+  // stored, memory use is constant and there is no limit on their number.
+  //
+  // The result is accurate only if the work limit was not reached. If a
+  // deadline is given, counting stops when it expires, and the result is
+  // reported as if the work limit was reached.
+  EnumerateResult CountMarginals(
+      Marginals &marginals, int64_t max_work = 1e18, Deadline *deadline = nullptr);
+
   // Recursively fixes all cells that only have a single option left, and
   // returns number of cell values fixed this waty.
   int FixDetermined();
@@ -188,12 +233,19 @@ private:
 
   // Note: the logic here is very similar to CountSolutions().
   template<typename C>
-  bool EnumerateSolutionsImpl(const C &callback, std::span<Position> todo, int64_t &work_left) {
+  bool EnumerateSolutionsImpl(
+      const C &callback, std::span<Position> todo, int64_t &work_left,
+      Deadline *deadline) {
     if (todo.empty()) {
       // Solution found!
       return callback(const_cast<const std::array<uint8_t, 81>&>(digit));
     }
 
+    if (deadline && deadline->Poll(todo.size())) {
+      work_left = 0;
+      return true;
+    }
+
     // Find most constrained cell to fill in.
     int min_unused_count = 10;
     int min_unused_index = -1;
@@ -229,7 +281,7 @@ private:
       unused_col[c] ^= mask;
       unused_box[b] ^= mask;
 
-      bool result = EnumerateSolutionsImpl<C>(callback, remaining, work_left);
+      bool result = EnumerateSolutionsImpl<C>(callback, remaining, work_left, deadline);
 
       unused_row[r] ^= mask;
       unused_col[c] ^= mask;
@@ -250,6 +302,17 @@ private:
   // Recursively counts solutions.
   void CountSolutions(std::span<Position> todo, CountState &cs);
 
+  struct MarginalsState {
+    Marginals &marginals;
+    int64_t work_left;
+    Deadline *deadline;
+    // Index of each cell in marginals.pair_cells, or -1 if absent.
+    int8_t pair_index[81];
+  };
+
+  // Recursively counts marginals, and returns the number of solutions.
+  int64_t CountMarginals(std::span<Position> todo, MarginalsState &ms);
+
   std::array<uint8_t, 81> digit = {};
   static constexpr unsigned A = 0b1111111110;  // all-digit bitmask
   unsigned unused_row[9] = {A, A, A, A, A, A, A, A, A};
@@ -0,0 +1,128 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+bool collect_stats = false;
+
+namespace {
+
+constexpr int percentiles[] = {0, 10, 20, 30, 40, 50, 60, 70, 80, 90, 91, 92, 93, 94, 95, 96, 97, 98, 99, 100};
+
+// Shards are never deallocated, so that statistics collected by threads that
+// have exited are still included by CollectStats().
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<Stats>> shards;
+};
+
+Registry &GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+void PrintRow(std::ostream &os, const char *name, const Histogram &h) {
+  os << name << std::setw(9) << h.Count()
+      << std::fixed << std::setw(6) << std::setprecision(1) << h.Mean();
+  for (int percentile : percentiles) os << std::setw(6) << h.Percentile(percentile);
+  os << '\n';
+}
+
+void PrintCompact(std::ostream &os, const char *name, const Histogram &h) {
+  os << name << '=' << h.Count() << '/'
+      << std::fixed << std::setprecision(1) << h.Mean() << '/'
+      << h.Percentile(50) << '/' << h.Percentile(90) << '/'
+      << h.Percentile(99) << '/' << h.Max();
+}
+
+// Prints counters by depth as a comma-separated list, omitting trailing zeros.
+void PrintByDepth(std::ostream &os, const StatCounter (&counters)[Stats::max_depth]) {
+  int n = Stats::max_depth;
+  while (n > 0 && counters[n - 1].Get() == 0) --n;
+  for (int i = 0; i < n; ++i) {
+    if (i > 0) os << ',';
+    os << counters[i].Get();
+  }
+}
+
+}  // namespace
+
+void Histogram::Merge(const Histogram &h) {
+  for (int i = 0; i < bucket_count; ++i) buckets[i].Add(h.buckets[i].Get());
+  count.Add(h.count.Get());
+  sum.Add(h.sum.Get());
+  max.Max(h.max.Get());
+}
+
+uint64_t Histogram::Percentile(int percentile) const {
+  uint64_t n = Count();
+  if (n == 0) return 0;
+  if (percentile >= 100) return Max();
+  // Rank of the requested sample (1-based).
+  uint64_t rank = std::max<uint64_t>(1, (n * percentile + 99) / 100);
+  uint64_t seen = 0;
+  for (int i = 0; i < bucket_count; ++i) {
+    seen += buckets[i].Get();
+    if (seen >= rank) return std::min(BucketMin(i), Max());
+  }
+  return Max();
+}
+
+void Stats::Merge(const Stats &s) {
+  winning_solutions.Merge(s.winning_solutions);
+  solutions.Merge(s.solutions);
+  positions.Merge(s.positions);
+  moves.Merge(s.moves);
+  for (int i = 0; i < max_depth; ++i) {
+    nodes_by_depth[i].Add(s.nodes_by_depth[i].Get());
+    memo_hits_by_depth[i].Add(s.memo_hits_by_depth[i].Get());
+  }
+}
+
+Stats *RegisterLocalStats() {
+  Registry &registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.shards.push_back(std::make_unique<Stats>());
+  return registry.shards.back().get();
+}
+
+Stats CollectStats() {
+  Registry &registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  Stats result;
+  for (const auto &shard : registry.shards) result.Merge(*shard);
+  return result;
+}
+
+void PrintStats(std::ostream &os, const Stats &stats) {
+  os << "            " << std::setw(9) << "samples" << std::setw(6) << "avg.";
+  for (int percentile : percentiles) os << std::setw(5) << percentile << '%';
+  os << '\n';
+  PrintRow(os, "win. sols   ", stats.winning_solutions);
+  PrintRow(os, "rem. sols   ", stats.solutions);
+  PrintRow(os, "rem. posits ", stats.positions);
+  PrintRow(os, "rem. moves  ", stats.moves);
+  os << "nodes by depth: ";
+  PrintByDepth(os, stats.nodes_by_depth);
+  os << "\nmemo hits by depth: ";
+  PrintByDepth(os, stats.memo_hits_by_depth);
+  os << '\n';
+}
+
+void PrintStatsCompact(std::ostream &os, const Stats &stats) {
+  PrintCompact(os, "wsols", stats.winning_solutions);
+  os << ' ';
+  PrintCompact(os, "sols", stats.solutions);
+  os << ' ';
+  PrintCompact(os, "posits", stats.positions);
+  os << ' ';
+  PrintCompact(os, "moves", stats.moves);
+  os << " nodes=";
+  PrintByDepth(os, stats.nodes_by_depth);
+  os << " hits=";
+  PrintByDepth(os, stats.memo_hits_by_depth);
+}
@@ -0,0 +1,125 @@
+// Low-overhead statistics about the analysis search.
+//
+// Unlike the counters in counters.h (which are only enabled in local builds),
+// statistics are available in all builds, but they are only collected when
+// enabled at runtime (with the --collect-stats option of the player and
+// solver). When disabled, the cost is a single well-predicted branch per
+// recursive call.
+//
+// Each thread collects statistics into its own shard (so no synchronization
+// is needed on the hot path). CollectStats() merges all shards.
+
+#ifndef STATS_H_INCLUDED
+#define STATS_H_INCLUDED
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <ostream>
+
+// Whether statistics are collected. Set from the --collect-stats option of
+// the player and solver.
+extern bool collect_stats;
+
+// A counter that is written by a single thread, but may be read by others.
+//
+// Relaxed loads and stores compile to plain memory accesses, so this is as
+// cheap as an ordinary integer, but concurrent reads are not a data race.
+class StatCounter {
+public:
+  StatCounter() = default;
+  StatCounter(const StatCounter &c) : value(c.Get()) {}
+  StatCounter &operator=(const StatCounter &c) { Set(c.Get()); return *this; }
+
+  uint64_t Get() const { return value.load(std::memory_order_relaxed); }
+  void Set(uint64_t v) { value.store(v, std::memory_order_relaxed); }
+  void Add(uint64_t v) { Set(Get() + v); }
+  void Max(uint64_t v) { if (v > Get()) Set(v); }
+
+private:
+  std::atomic<uint64_t> value = 0;
+};
+
+// Histogram with fixed log-linear buckets: values below 4 each have their own
+// bucket, and every power-of-two interval above that is split into 4 buckets,
+// so the relative error of reported percentiles is at most 25%. The mean and
+// maximum are exact.
+class Histogram {
+public:
+  static constexpr int bucket_count = 128;
+
+  static constexpr int Bucket(uint64_t v) {
+    if (v < 4) return v;
+    int e = std::bit_width(v) - 1;
+    int i = 4*(e - 1) + ((v >> (e - 2)) & 3);
+    return i < bucket_count ? i : bucket_count - 1;
+  }
+
+  // Returns the smallest value that falls in bucket i.
+  static constexpr uint64_t BucketMin(int i) {
+    if (i < 4) return i;
+    return (uint64_t) (4 + (i & 3)) << (i/4 - 1);
+  }
+
+  void Add(uint64_t v) {
+    buckets[Bucket(v)].Add(1);
+    count.Add(1);
+    sum.Add(v);
+    max.Max(v);
+  }
+
+  void Merge(const Histogram &h);
+
+  uint64_t Count() const { return count.Get(); }
+  uint64_t Max() const { return max.Get(); }
+  double Mean() const { return Count() ? (double) sum.Get() / Count() : 0.0; }
+
+  // Returns an approximation of the given percentile (between 0 and 100).
+  uint64_t Percentile(int percentile) const;
+
+private:
+  StatCounter buckets[bucket_count];
+  StatCounter count, sum, max;
+};
+
+struct Stats {
+  static constexpr int max_depth = 81;
+
+  // Solution counts in positions with an immediately winning move.
+  Histogram winning_solutions;
+
+  // Solution counts, choice positions and moves in positions that are
+  // searched recursively.
+  Histogram solutions;
+  Histogram positions;
+  Histogram moves;
+
+  // Number of positions visited, and number answered by the memo, by search
+  // depth (where depth 0 are the direct children of the root).
+  StatCounter nodes_by_depth[max_depth];
+  StatCounter memo_hits_by_depth[max_depth];
+
+  void Merge(const Stats &s);
+};
+
+// Allocates a new shard and registers it with CollectStats(). Use
+// LocalStats() instead of calling this directly.
+Stats *RegisterLocalStats();
+
+// Returns the statistics shard of the current thread.
+inline Stats &LocalStats() {
+  thread_local Stats *local_stats = RegisterLocalStats();
+  return *local_stats;
+}
+
+// Returns the sum of the statistics collected by all threads so far.
+Stats CollectStats();
+
+// Prints statistics in a human-readable table.
+void PrintStats(std::ostream &os, const Stats &stats);
+
+// Prints statistics on a single line in a compact format, suitable for the
+// player log. Each histogram is printed as count/mean/p50/p90/p99/max.
+void PrintStatsCompact(std::ostream &os, const Stats &stats);
+
+#endif  // ndef STATS_H_INCLUDED
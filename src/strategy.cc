@@ -0,0 +1,263 @@
+#include "strategy.h"
+
+#include "analysis.h"
+#include "bands.h"
+#include "logging.h"
+#include "random.h"
+#include "state.h"
+#include "timer.h"
+#include "trace.h"
+
+#include <cassert>
+#include <chrono>
+#include <span>
+#include <vector>
+
+namespace {
+
+Move PickRandomMove(const State &state, rng_t &rng) {
+  std::vector<Move> moves;
+  for (int pos = 0; pos < 81; ++pos) {
+    if (state.Digit(pos) == 0) {
+      unsigned unused = state.CellUnused(pos);
+      // Skip cells that are known to be unique. (Passing this check doesn't
+      // mean the move is valid, but it's not known to be invalid, which is
+      // better than nothing!)
+      if ((unused & (unused - 1)) == 0) continue;
+      for (int digit = 1; digit <= 9; ++digit) if (unused & (1u << digit)) {
+        moves.push_back(Move{.pos = pos, .digit = digit});
+      }
+    }
+  }
+  return RandomSample(moves, rng);
+}
+
+// Pick a move given the number of solutions per cell and digit.
+// It returns a random move that maximizes the number of solutions remaining.
+Move PickMoveFromMarginals(const State &state, const Marginals &marginals, rng_t &rng) {
+  assert(marginals.total > 0);
+  std::vector<Move> best_moves;
+#if MAXIMIZE_SOLUTIONS_REMAINING
+  int64_t max_count = 0;
+#endif
+  for (int pos = 0; pos < 81; ++pos) {
+    if (state.Digit(pos) == 0) {
+      for (int digit = 1; digit <= 9; ++digit) {
+        int64_t c = marginals.count[pos][digit];
+        assert(c <= marginals.total);
+        if (c == marginals.total) continue;  // Must reduce solution set size!
+#if MAXIMIZE_SOLUTIONS_REMAINING
+        if (c > max_count) {
+          max_count = c;
+          best_moves.clear();
+        }
+        if (max_count > 0 && c == max_count) {
+          best_moves.push_back(Move{.pos = pos, .digit = digit});
+        }
+#else
+        if (c > 0) {
+          best_moves.push_back(Move{.pos = pos, .digit = digit});
+        }
+#endif
+      }
+    }
+  }
+#if MAXIMIZE_SOLUTIONS_REMAINING
+  assert(max_count > 0);
+#endif
+  assert(!best_moves.empty());
+  return RandomSample(best_moves, rng);
+}
+
+// Pick a move from an incomplete list of solutions.
+Move PickMoveIncomplete(const State &state, std::span<const solution_t> solutions, rng_t &rng) {
+  assert(!solutions.empty());
+  Marginals marginals;
+  marginals.total = solutions.size();
+  for (const auto &solution : solutions) {
+    for (int i = 0; i < 81; ++i) {
+      ++marginals.count[i][solution[i]];
+    }
+  }
+  return PickMoveFromMarginals(state, marginals, rng);
+}
+
+}  // namespace
+
+Strategy::Strategy(const StrategyParams &params, bool logging, memo_t *shared_memo)
+  : params(params), logging(logging),
+    analysis_context(shared_memo ? AnalysisContext(*shared_memo) : AnalysisContext(params.memo_size)),
+    analyze_max_count(params.analyze_max_count) {
+  assert(params.canonical_memo_max_size >= 0 &&
+      params.canonical_memo_max_size <= max_canonical_memo_size);
+  analysis_context.canonical_memo_max_size = params.canonical_memo_max_size;
+}
+
+TurnInfo Strategy::SelectTurn(rng_t &rng, log_duration_t time_used) {
+  TurnInfo info;
+  std::chrono::duration<double> time_budget{0};  // in seconds
+  if (params.time_limit <= log_duration_t{0}) {
+    deadline.Reset();
+  } else {
+    // Heuristic: each turn, use a fraction of the remaining time. With the
+    // default fraction of 1/3 and a 30 second time limit this allocates: 10,
+    // 6.67, 4.44, 2.96, etc.
+    time_budget = (params.time_limit - time_used) * params.analyze_time_fraction;
+    deadline.Reset(Deadline::clock::now() +
+        std::chrono::duration_cast<Deadline::clock::duration>(time_budget));
+  }
+
+  if (!solutions_complete && moves_played >= params.enumerate_min_clues) {
+    // Try to enumerate all solutions.
+    TraceScope trace("enumerate");
+    Timer timer;
+    EnumerateResult er = state.EnumerateSolutions(
+        solutions, params.enumerate_max_count, params.enumerate_max_work, &rng, &deadline);
+    info.enumerate_time += timer.Elapsed();
+    trace.Arg("solutions", solutions.size()).Arg("accurate", er.Accurate());
+    if (er.Accurate()) {
+      solutions_complete = true;
+      if (solutions.empty()) {
+        if (logging) LogError() << "No solutions remain!";
+        return info;
+      }
+    } else if (solutions.empty()) {
+      if (logging) LogWarning() << "No solutions found! (this doesn't mean there aren't any)";
+    }
+  }
+  info.solution_count = solutions.size();
+  info.solutions_complete = solutions_complete;
+
+  // If there are too many solutions to enumerate, try to count them per cell
+  // and digit instead, which doesn't require storing them. Band decomposition
+  // gives the same counts as State::CountMarginals(), but is often faster.
+  std::optional<Marginals> marginals;
+  if (!solutions_complete && !solutions.empty() && params.marginals_max_work > 0 &&
+      moves_played >= marginals_next_attempt) {
+    TraceScope trace("marginals");
+    Timer timer;
+    marginals.emplace();
+    EnumerateResult er = params.marginals_by_bands
+        ? CountMarginalsByBands(state, *marginals, params.marginals_max_work, &deadline)
+        : state.CountMarginals(*marginals, params.marginals_max_work, &deadline);
+    info.enumerate_time += timer.Elapsed();
+    trace.Arg("solutions", marginals->total).Arg("accurate", er.Accurate());
+    if (er.Accurate()) {
+      info.solution_count = marginals->total;
+      info.solutions_complete = true;
+    } else {
+      // Counting would likely fail again on our next turn, since the solution
+      // count decreases slowly in the opening, so skip that turn.
+      marginals.reset();
+      marginals_next_attempt = moves_played + 4;
+    }
+  }
+  if (logging) LogSolutions(info.solution_count, info.solutions_complete);
+
+  if (marginals) {
+    // Too many solutions to analyze, but exact counts are known.
+    info.turn = Turn(PickMoveFromMarginals(state, *marginals, rng));
+  } else if (solutions.empty()) {
+    // I don't know anything about solutions. Just pick randomly.
+    info.turn = Turn(PickRandomMove(state, rng));
+  } else if (!solutions_complete || solutions.size() > analyze_max_count) {
+    // I have some solutions but it's not the complete set.
+    info.turn = Turn(PickMoveIncomplete(state, solutions, rng));
+  } else {
+    // The hard case: select optimal move given the complete set of solutions.
+    TraceScope trace("analyze");
+    trace.Arg("solutions", solutions.size());
+    Timer timer;
+    grid_t givens = {};
+    for (int i = 0; i < 81; ++i) givens[i] = state.Digit(i);
+    AnalyzeResult result;
+    bool skipped = false;
+    if (params.analyze_estimate_probes > 0) {
+      // Skip analysis if it is unlikely to complete within the budget, so
+      // that the time is saved for later turns.
+      int64_t estimate = params.analyze_estimate_scale * EstimateAnalysisWork(
+          analysis_context, givens, solutions, params.analyze_estimate_probes, rng);
+      int64_t budget = params.analyze_max_work;
+      if (params.time_limit > log_duration_t{0}) {
+        // Always allow 10 ms of work, so that small positions are still
+        // analyzed when the time budget has run out.
+        budget = std::max<int64_t>(time_budget.count() * params.analyze_work_rate,
+            params.analyze_work_rate / 100);
+      }
+      trace.Arg("estimate", estimate).Arg("budget", budget);
+      if (estimate > budget) {
+        if (logging) {
+          LogInfo() << "Skipping analysis: estimated work " << estimate
+              << " exceeds budget " << budget;
+        }
+        skipped = true;
+      }
+    }
+    if (skipped) {
+      // Don't change analyze_max_count, since the estimate may be lower on
+      // our next turn, even if the solution count is the same.
+    } else if (params.time_limit <= log_duration_t{0}) {
+      result = Analyze(analysis_context, givens, solutions, 1, params.analyze_max_work, &deadline);
+    } else {
+      // Analyze in batches until the deadline, which also aborts the batch
+      // that is running when it expires.
+      for (;;) {
+        result = Analyze(analysis_context, givens, solutions, 1, params.analyze_batch_size, &deadline);
+        if (result.outcome || deadline.Expired()) break;
+        if (logging) LogInfo() << "Continuing analysis";
+      }
+    }
+    info.analyze_time += timer.Elapsed();
+    if (skipped) {
+      info.turn = Turn(PickMoveIncomplete(state, solutions, rng));
+    } else if (!result.outcome) {
+      if (logging) LogWarning() << "Analysis aborted!";
+      // Fall back to pseudo-random selection.
+      info.turn = Turn(PickMoveIncomplete(state, solutions, rng));
+      // Reduce max_analyze so that we don't try to re-analyze until the
+      // solution set is smaller.
+      analyze_max_count = solutions.size() - 1;
+    } else {
+      info.turn = RandomSample(result.optimal_turns, rng);
+      info.outcome = result.outcome;
+      if (logging) {
+        LogOutcome(*result.outcome);
+        if (result.cached) LogInfo() << "Winning move taken from strategy cache";
+        if (info.turn.claim_unique) LogInfo() << "That's Numberwang!";
+      }
+      // Detect bugs in analysis:
+      bool new_winning = IsWinning(*result.outcome);
+      if (winning && !new_winning && logging) {
+        LogWarning() << "State went from winning to losing! "
+            << "(this means there is a bug in analysis)";
+      }
+      winning = new_winning;
+    }
+  }
+  return info;
+}
+
+void Strategy::PlayMove(const Move &move) {
+  state.Play(move);
+  ++moves_played;
+
+  if (!solutions.empty()) {
+    if (!solutions_complete) {
+      // Just clear solutions. We'll regenerate them next turn.
+      solutions.clear();
+    } else {
+      // Narrow down set of solutions.
+      std::vector<solution_t> next_solutions;
+      for (const auto &solution : solutions) {
+        if (solution[move.pos] == move.digit) {
+          next_solutions.push_back(solution);
+        }
+      }
+      if (solutions.size() == next_solutions.size() && logging) {
+        LogWarning() << "Non-reducing move: " << move;
+      }
+      solutions.swap(next_solutions);
+      assert(!solutions.empty());
+    }
+  }
+}
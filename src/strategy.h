@@ -0,0 +1,116 @@
+// The player's strategy, separated from the I/O handling in player.cc so that
+// it can also be used to simulate games in-process (see arena.h).
+
+#ifndef STRATEGY_H_INCLUDED
+#define STRATEGY_H_INCLUDED
+
+#include "analysis.h"
+#include "deadline.h"
+#include "logging.h"
+#include "memo.h"
+#include "random.h"
+#include "state.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Parameters that control the strategy. The player exposes most of these as
+// command line options (see player.cc for their descriptions).
+struct StrategyParams {
+  int enumerate_min_clues = 8;
+  int enumerate_max_count = 400'000;
+  int64_t enumerate_max_work = 20'000'000;
+  int analyze_max_count = 100'000;
+
+  // Work limit for counting solutions per cell and digit, when there are
+  // more than enumerate_max_count solutions (or 0 to disable). Disabled by
+  // default: in the opening, counting almost always hits the limit, so the
+  // work is wasted.
+  int64_t marginals_max_work = 0;
+
+  // Count solutions per cell and digit by band decomposition (see bands.h)
+  // instead of State::CountMarginals(). The counts are the same, but work also
+  // includes memo counters stored, so this usually needs a higher limit.
+  bool marginals_by_bands = false;
+
+  // Used only if time_limit is zero.
+  int64_t analyze_max_work = 100'000'000;
+
+  // Used only if time_limit is positive.
+  int64_t analyze_batch_size = 30'000'000;
+  log_duration_t time_limit{0};
+  double analyze_time_fraction = 1.0/3;
+
+  // If positive, the work of analysis is estimated with this many random
+  // probes (see EstimateAnalysisWork()) before analysis starts. Analysis is
+  // skipped if the estimate times analyze_estimate_scale exceeds the work
+  // budget: analyze_max_work, or with a time limit, the time budget of the
+  // turn times analyze_work_rate (work per second).
+  int analyze_estimate_probes = 0;
+  double analyze_estimate_scale = 25;
+  int64_t analyze_work_rate = 15'000'000;
+
+  // See AnalysisContext::canonical_memo_max_size.
+  int canonical_memo_max_size = 0;
+
+  size_t memo_size = LossyMemo::default_size;
+};
+
+// Summary of how a turn was selected, for logging and evaluation.
+struct TurnInfo {
+  // The selected turn, or an empty turn if an error occurred.
+  Turn turn;
+
+  // Number of solutions found, and whether that's all of them.
+  int64_t solution_count = 0;
+  bool solutions_complete = false;
+
+  // Outcome according to analysis, if analysis was performed and completed.
+  std::optional<Outcome> outcome;
+
+  log_duration_t enumerate_time{0};
+  log_duration_t analyze_time{0};
+};
+
+// Tracks the state of a single game from the point of view of one player, and
+// selects the player's turns.
+class Strategy {
+public:
+  // If `logging` is true, progress is logged to stderr using the functions in
+  // logging.h (this is what the player does).
+  //
+  // If `shared_memo` is not null, analysis uses it instead of allocating a
+  // memo of params.memo_size entries. The memo must outlive the strategy.
+  explicit Strategy(const StrategyParams &params, bool logging = false,
+      memo_t *shared_memo = nullptr);
+
+  const State &GetState() const { return state; }
+
+  // Selects a turn for the player to move. Note that this does not execute
+  // the turn: the caller should call PlayMove() for each move.
+  //
+  // `time_used` is the time used by the player before this turn started. It
+  // is only used if params.time_limit is positive.
+  TurnInfo SelectTurn(rng_t &rng, log_duration_t time_used);
+
+  // Updates the game state and refines the solutions set after playing the
+  // given move (by either player). The move must be valid.
+  void PlayMove(const Move &move);
+
+private:
+  StrategyParams params;
+  bool logging;
+
+  AnalysisContext analysis_context;
+  Deadline deadline;
+  State state = {};
+  int moves_played = 0;
+  int marginals_next_attempt = 0;
+  std::vector<solution_t> solutions = {};
+  bool solutions_complete = false;
+  bool winning = false;
+  size_t analyze_max_count;
+};
+
+#endif  // ndef STRATEGY_H_INCLUDED
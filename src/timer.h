@@ -0,0 +1,53 @@
+#ifndef TIMER_H_INCLUDED
+#define TIMER_H_INCLUDED
+
+#include "logging.h"
+
+#include <cassert>
+#include <chrono>
+
+// A simple timer. Can be running or paused. Tracks time both while running and
+// while paused. Use Elapsed() to query, Pause() and Resume() to switch states.
+class Timer {
+public:
+  Timer(bool running = true) : running(running) {}
+
+  bool Running() const { return running; }
+  bool Paused() const { return !running; }
+
+  // Returns how much time passed in the given state, in total.
+  log_duration_t Elapsed(bool while_running = true) {
+    clock_t::duration d = elapsed[while_running];
+    if (running == while_running) d += clock_t::now() - start;
+    return std::chrono::duration_cast<log_duration_t>(d);
+  }
+
+  log_duration_t Pause() {
+    assert(Running());
+    return TogglePause();
+  }
+
+  log_duration_t Resume() {
+    assert(Paused());
+    return TogglePause();
+  }
+
+  // Toggles running state, and returns how much time passed since last toggle.
+  log_duration_t TogglePause() {
+    auto end = clock_t::now();
+    auto delta = end - start;
+    elapsed[running] += delta;
+    start = end;
+    running = !running;
+    return std::chrono::duration_cast<log_duration_t>(delta);
+  }
+
+private:
+  using clock_t = std::chrono::steady_clock;
+
+  bool running = false;
+  clock_t::time_point start = clock_t::now();
+  clock_t::duration elapsed[2] = {clock_t::duration{0}, clock_t::duration{0}};
+};
+
+#endif  // ndef TIMER_H_INCLUDED
@@ -0,0 +1,141 @@
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+namespace trace::internal {
+bool enabled = false;
+}
+
+namespace {
+
+using trace_clock = std::chrono::steady_clock;
+
+const trace_clock::time_point trace_start_time = trace_clock::now();
+
+struct Tracer {
+  std::mutex mutex;
+  FILE *fp = nullptr;
+  std::string buffer;
+  int pid = 0;
+  bool first_event = true;
+};
+
+Tracer tracer;
+
+// Returns a small integer that identifies the current thread in the trace.
+int ThreadId() {
+  static std::atomic<int> next_id = 1;
+  thread_local int id = next_id++;
+  return id;
+}
+
+void AppendEscaped(std::string &s, std::string_view value) {
+  for (char ch : value) {
+    if (ch == '"' || ch == '\\') s += '\\';
+    if ((unsigned char) ch >= 0x20) s += ch;
+  }
+}
+
+// Appends a single event object to the buffer. Must hold tracer.mutex.
+void AppendEvent(std::string_view event) {
+  // The trace is written as a JSON array, but the closing bracket is written
+  // only when tracing stops. The trace viewers accept traces without it, which
+  // means partial traces (e.g. if the process is killed) can still be opened.
+  tracer.buffer += tracer.first_event ? "[\n" : ",\n";
+  tracer.first_event = false;
+  tracer.buffer += event;
+}
+
+void StopTracing() {
+  if (!TraceEnabled()) return;
+  FlushTrace();
+  std::lock_guard<std::mutex> lock(tracer.mutex);
+  fputs("\n]\n", tracer.fp);
+  fclose(tracer.fp);
+  tracer.fp = nullptr;
+  trace::internal::enabled = false;
+}
+
+}  // namespace
+
+bool StartTracing(std::string_view process_name, const std::string &filename) {
+  if (filename.empty()) return true;
+  std::lock_guard<std::mutex> lock(tracer.mutex);
+  tracer.fp = fopen(filename.c_str(), "w");
+  if (tracer.fp == nullptr) {
+    std::cerr << "Could not open trace file: " << filename << std::endl;
+    return false;
+  }
+  tracer.pid = getpid();
+  std::string event = "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":"
+      + std::to_string(tracer.pid) + ",\"args\":{\"name\":\"";
+  AppendEscaped(event, process_name);
+  event += "\"}}";
+  AppendEvent(event);
+  trace::internal::enabled = true;
+  atexit(StopTracing);
+  return true;
+}
+
+void FlushTrace() {
+  if (!TraceEnabled()) return;
+  std::lock_guard<std::mutex> lock(tracer.mutex);
+  fwrite(tracer.buffer.data(), 1, tracer.buffer.size(), tracer.fp);
+  fflush(tracer.fp);
+  tracer.buffer.clear();
+}
+
+int64_t TraceNow() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      trace_clock::now() - trace_start_time).count();
+}
+
+void TraceComplete(std::string_view name, int64_t start, std::string_view args) {
+  if (!TraceEnabled()) return;
+  int64_t end = TraceNow();
+  std::string event = "{\"name\":\"";
+  AppendEscaped(event, name);
+  event += "\",\"ph\":\"X\",\"pid\":" + std::to_string(tracer.pid)
+      + ",\"tid\":" + std::to_string(ThreadId())
+      + ",\"ts\":" + std::to_string(start)
+      + ",\"dur\":" + std::to_string(end - start);
+  if (!args.empty()) {
+    event += ",\"args\":{";
+    event += args;
+    event += '}';
+  }
+  event += '}';
+  std::lock_guard<std::mutex> lock(tracer.mutex);
+  AppendEvent(event);
+}
+
+TraceScope &TraceScope::Arg(std::string_view key, int64_t value) {
+  if (TraceEnabled()) {
+    if (!args.empty()) args += ',';
+    args += '"';
+    AppendEscaped(args, key);
+    args += "\":";
+    args += std::to_string(value);
+  }
+  return *this;
+}
+
+TraceScope &TraceScope::Arg(std::string_view key, std::string_view value) {
+  if (TraceEnabled()) {
+    if (!args.empty()) args += ',';
+    args += '"';
+    AppendEscaped(args, key);
+    args += "\":\"";
+    AppendEscaped(args, value);
+    args += '"';
+  }
+  return *this;
+}
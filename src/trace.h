@@ -0,0 +1,67 @@
+// Optional tracing of events in the Chrome trace event format, which can be
+// viewed with chrome://tracing or https://ui.perfetto.dev/
+//
+// Tracing is enabled by calling StartTracing() with a file name (which the
+// player and solver take from their --trace-file option). Events are buffered
+// in memory and written to the file by FlushTrace(), which should be called at
+// a point where the extra latency doesn't matter (e.g. after the player sent
+// its move).
+//
+// Events are recorded at a coarse granularity (enumeration, analysis batches,
+// top-level moves, I/O, etc.) so the overhead is negligible, but nothing at all
+// is recorded when tracing is disabled.
+
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace trace::internal {
+extern bool enabled;
+}
+
+// Returns whether StartTracing() was called successfully.
+inline bool TraceEnabled() { return trace::internal::enabled; }
+
+// Starts tracing to `filename`, unless it is empty. Returns false only if the
+// trace file could not be opened.
+//
+// The trace is finalized automatically when the process exits normally.
+bool StartTracing(std::string_view process_name, const std::string &filename);
+
+// Writes buffered events to the trace file.
+void FlushTrace();
+
+// Returns the current time in microseconds (the unit used in trace files).
+int64_t TraceNow();
+
+// Records a complete event that started at `start` and ends now. `args`, if
+// not empty, must contain comma-separated JSON object members.
+void TraceComplete(std::string_view name, int64_t start, std::string_view args = {});
+
+// Records an event that lasts from construction until destruction of this
+// object, with optional arguments that are shown in the trace viewer.
+class TraceScope {
+public:
+  explicit TraceScope(std::string_view name)
+    : name(name), start(TraceEnabled() ? TraceNow() : 0) {}
+
+  ~TraceScope() {
+    if (TraceEnabled()) TraceComplete(name, start, args);
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope &operator=(const TraceScope&) = delete;
+
+  TraceScope &Arg(std::string_view key, int64_t value);
+  TraceScope &Arg(std::string_view key, std::string_view value);
+
+private:
+  std::string_view name;
+  int64_t start;
+  std::string args;
+};
+
+#endif  // ndef TRACE_H_INCLUDED
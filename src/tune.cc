@@ -0,0 +1,333 @@
+// Compares two player configurations using a sequential probability ratio test
+// (SPRT), based on games simulated in-process (see arena.h).
+//
+// Games are played in pairs with the same random seed, where the players switch
+// sides in the second game. Since both games of a pair share the same random
+// choices, their outcomes are correlated, so the test is based on the score per
+// pair rather than per game (which is known as the "pentanomial" model). This
+// reduces the number of games needed to reach a conclusion.
+//
+// The test stops when the log-likelihood ratio (LLR) of the hypotheses
+// H0: elo = elo0 and H1: elo = elo1 crosses one of the bounds determined by
+// alpha and beta (or when the maximum number of pairs has been played). The
+// LLR is calculated with the usual normal approximation (GSPRT).
+//
+// Example:
+//
+//   tune --candidate=default,analyze-max-count=50000 --elo1=20 --time-limit=5
+
+#include "arena.h"
+#include "options.h"
+#include "random.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+DECLARE_OPTION(bool, arg_help, false, "help",
+    "show usage information");
+
+DECLARE_OPTION(std::string, arg_baseline, "default", "baseline",
+    "Specification of the baseline player (see arena.h for the syntax).");
+
+DECLARE_OPTION(std::string, arg_candidate, "", "candidate",
+    "Specification of the candidate player. Elo differences are reported "
+    "from the candidate's perspective.");
+
+DECLARE_OPTION(int, arg_elo0, 0, "elo0",
+    "Elo difference under the null hypothesis.");
+
+DECLARE_OPTION(int, arg_elo1, 20, "elo1",
+    "Elo difference under the alternative hypothesis.");
+
+DECLARE_OPTION(int, arg_alpha_percent, 5, "alpha",
+    "Probability of accepting H1 when H0 is true, in percent.");
+
+DECLARE_OPTION(int, arg_beta_percent, 5, "beta",
+    "Probability of accepting H0 when H1 is true, in percent.");
+
+DECLARE_OPTION(int, arg_max_pairs, 5000, "max-pairs",
+    "Maximum number of game pairs to play.");
+
+DECLARE_OPTION(int, arg_time_limit, 0, "time-limit",
+    "Time limit in seconds for both players (or 0 to use their work limits). "
+    "Overrides the time-limit key of the player specifications.");
+
+DECLARE_OPTION(int, arg_jobs, std::max(1u, std::thread::hardware_concurrency()), "jobs",
+    "Number of game pairs to play in parallel.");
+
+DECLARE_OPTION(std::string, arg_seed, "", "seed",
+    "Random seed in hexadecimal format. If empty, pick randomly.");
+
+DECLARE_OPTION(int64_t, arg_memo_size, 1 << 22, "memo-size",
+    "Default number of memo entries per player (must be a power of 2).");
+
+DECLARE_OPTION(std::string, arg_log, "", "log",
+    "File to write game records to (or - for standard output).");
+
+// Result of a pair of games, from the candidate's perspective.
+struct PairResult {
+  // Score in half points: 2 for a win, 1 for a tie, 0 for a loss, so between
+  // 0 and 4 for a pair of games.
+  int half_points = 0;
+
+  // CPU time used by the baseline (0) and candidate (1).
+  std::chrono::nanoseconds cpu_time[2] = {};
+
+  GameRecord games[2];
+};
+
+// Expected score for a given Elo difference.
+double EloToScore(double elo) {
+  return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0));
+}
+
+double ScoreToElo(double score) {
+  score = std::clamp(score, 1e-6, 1.0 - 1e-6);
+  return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+// Running statistics over pair results, with scores normalized to [0, 1].
+class PairStats {
+public:
+  void Add(int half_points) {
+    ++count[half_points];
+    ++pairs;
+  }
+
+  int Pairs() const { return pairs; }
+
+  double Mean() const {
+    double sum = 0, total = 0;
+    for (int i = 0; i < 5; ++i) {
+      sum += Weight(i) * (i / 4.0);
+      total += Weight(i);
+    }
+    return sum / total;
+  }
+
+  double Variance() const {
+    double m = Mean(), sum = 0, total = 0;
+    for (int i = 0; i < 5; ++i) {
+      sum += Weight(i) * (i / 4.0 - m) * (i / 4.0 - m);
+      total += Weight(i);
+    }
+    return sum / total;
+  }
+
+  // Generalized SPRT log-likelihood ratio of H1: elo1 versus H0: elo0.
+  double LLR(double elo0, double elo1) const {
+    double var = Variance();
+    if (pairs < 2) return 0.0;
+    double s0 = EloToScore(elo0), s1 = EloToScore(elo1);
+    return pairs * (s1 - s0) * (2*Mean() - s0 - s1) / (2*var);
+  }
+
+  // Returns a 95% confidence interval for the mean score.
+  std::pair<double, double> ScoreInterval() const {
+    double margin = pairs ? 1.96 * std::sqrt(Variance() / pairs) : 0.5;
+    return {Mean() - margin, Mean() + margin};
+  }
+
+  int Count(int half_points) const { return count[half_points]; }
+
+private:
+  // Counts are regularized slightly, so that the variance is positive even if
+  // all pairs had the same score (which is common when comparing players of
+  // very different strength).
+  double Weight(int i) const { return count[i] + 1e-3; }
+
+  int count[5] = {};
+  int pairs = 0;
+};
+
+int HalfPoints(const GameRecord &record, int player) {
+  if (record.outcomes[player] == GameOutcome::WIN) return 2;
+  if (record.outcomes[1 - player] == GameOutcome::WIN) return 0;
+  return 1;  // tie
+}
+
+PairResult PlayPair(const PlayerConfig configs[2], const rng_seed_t &seed) {
+  PairResult result;
+  for (int i = 0; i < 2; ++i) {
+    // In game i, configs[i] moves first. The candidate is configs[1].
+    const PlayerConfig *players[2] = {&configs[i], &configs[1 - i]};
+    GameRecord &record = result.games[i];
+    record = SimulateGame(players, seed);
+    int candidate = 1 - i;
+    result.half_points += HalfPoints(record, candidate);
+    result.cpu_time[0] += record.cpu_time[i];
+    result.cpu_time[1] += record.cpu_time[candidate];
+  }
+  return result;
+}
+
+void PrintStatus(std::ostream &os, const PairStats &stats, double llr,
+    double lower_bound, double upper_bound) {
+  auto [lo, hi] = stats.ScoreInterval();
+  os << std::fixed << std::setprecision(1)
+      << "Pairs: " << stats.Pairs()
+      << "  Score: " << 100*stats.Mean() << "% [" << 100*lo << "%, " << 100*hi << "%]"
+      << "  Elo: " << ScoreToElo(stats.Mean())
+      << " [" << ScoreToElo(lo) << ", " << ScoreToElo(hi) << "]"
+      << std::setprecision(2)
+      << "  LLR: " << llr << " (" << lower_bound << ", " << upper_bound << ")"
+      << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (!ParseOptions(argc, argv) || arg_help || arg_candidate.empty()) {
+    std::ostream &os = arg_help ? std::cout : std::clog;
+    os << "Usage: tune --candidate=<spec> [<options>]\n\nOptions:\n";
+    PrintOptionUsage(os);
+    return EXIT_FAILURE;
+  }
+
+  if (arg_memo_size <= 0 || (arg_memo_size & (arg_memo_size - 1)) != 0) {
+    std::cerr << "Memo size must be a power of 2!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (arg_alpha_percent <= 0 || arg_alpha_percent >= 100 ||
+      arg_beta_percent <= 0 || arg_beta_percent >= 100 || arg_elo0 >= arg_elo1) {
+    std::cerr << "Invalid test parameters!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  StrategyParams base_params;
+  base_params.memo_size = arg_memo_size;
+
+  // configs[0] is the baseline, configs[1] the candidate.
+  PlayerConfig configs[2];
+  for (int i = 0; i < 2; ++i) {
+    const std::string &spec = i == 0 ? arg_baseline : arg_candidate;
+    auto config = ParsePlayerConfig(spec, base_params);
+    if (!config) {
+      std::cerr << "Invalid player specification: [" << spec << "]" << std::endl;
+      return EXIT_FAILURE;
+    }
+    configs[i] = *config;
+    if (arg_time_limit > 0) {
+      configs[i].params.time_limit = std::chrono::seconds(arg_time_limit);
+    }
+  }
+
+  rng_seed_t seed;
+  if (arg_seed.empty()) {
+    seed = GenerateSeed(4);
+  } else if (auto s = ParseSeed(arg_seed)) {
+    seed = *s;
+  } else {
+    std::cerr << "Could not parse RNG seed: [" << arg_seed << "]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::ofstream log_file;
+  std::ostream *log = nullptr;
+  if (arg_log == "-") {
+    log = &std::cout;
+  } else if (!arg_log.empty()) {
+    log_file.open(arg_log);
+    if (!log_file) {
+      std::cerr << "Could not open log file: " << arg_log << std::endl;
+      return EXIT_FAILURE;
+    }
+    log = &log_file;
+  }
+
+  const double alpha = arg_alpha_percent / 100.0, beta = arg_beta_percent / 100.0;
+  const double lower_bound = std::log(beta / (1 - alpha));
+  const double upper_bound = std::log((1 - beta) / alpha);
+
+  std::cout << "Baseline:  " << configs[0].name << '\n'
+      << "Candidate: " << configs[1].name << '\n'
+      << "Seed:      " << FormatSeed(seed) << '\n'
+      << "SPRT:      elo0=" << arg_elo0 << " elo1=" << arg_elo1
+      << " alpha=" << alpha << " beta=" << beta << '\n' << std::endl;
+
+  const size_t max_pairs = std::max(arg_max_pairs, 0);
+  std::vector<std::optional<PairResult>> results(max_pairs);
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<size_t> next_pair = 0;
+  std::atomic<bool> stop = false;
+
+  auto worker = [&]() {
+    for (size_t i; !stop && (i = next_pair++) < max_pairs; ) {
+      rng_seed_t pair_seed = seed;
+      pair_seed.push_back(i);
+      PairResult result = PlayPair(configs, pair_seed);
+      std::lock_guard<std::mutex> lock(mutex);
+      results[i] = std::move(result);
+      cv.notify_one();
+    }
+  };
+
+  auto start_time = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < arg_jobs && (size_t) i < max_pairs; ++i) threads.emplace_back(worker);
+
+  // Results are processed in order, so that the outcome of the test doesn't
+  // depend on the number of threads or on timing.
+  PairStats stats;
+  std::chrono::nanoseconds cpu_time[2] = {};
+  double llr = 0;
+  for (size_t i = 0; i < max_pairs; ++i) {
+    PairResult result;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&results, i]() { return results[i].has_value(); });
+      result = std::move(*results[i]);
+      results[i].reset();
+    }
+    stats.Add(result.half_points);
+    for (int j = 0; j < 2; ++j) cpu_time[j] += result.cpu_time[j];
+    if (log) {
+      for (int j = 0; j < 2; ++j) {
+        *log << 2*i + j + 1 << '\t' << configs[j].name << '\t' << configs[1 - j].name << '\t';
+        PrintGameRecord(*log, result.games[j]);
+        *log << std::endl;
+      }
+    }
+    llr = stats.LLR(arg_elo0, arg_elo1);
+    bool done = llr <= lower_bound || llr >= upper_bound || i + 1 == max_pairs;
+    if (done || stats.Pairs() % 10 == 0) {
+      PrintStatus(std::cout, stats, llr, lower_bound, upper_bound);
+    }
+    if (done) break;
+  }
+  stop = true;
+  for (std::thread &thread : threads) thread.join();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+  using seconds_t = std::chrono::duration<double>;
+  const int games = 2*stats.Pairs();
+  std::cout << '\n'
+      << "Pair scores (0, 1/4, 1/2, 3/4, 1):";
+  for (int i = 0; i < 5; ++i) std::cout << ' ' << stats.Count(i);
+  std::cout << '\n' << std::fixed << std::setprecision(3)
+      << "CPU time per game: baseline " << seconds_t(cpu_time[0]).count() / games
+      << " s, candidate " << seconds_t(cpu_time[1]).count() / games << " s\n"
+      << games << " games in " << elapsed.count() << " s\n\n";
+  if (llr >= upper_bound) {
+    std::cout << "H1 accepted: candidate is stronger by at least " << arg_elo1 << " Elo." << std::endl;
+  } else if (llr <= lower_bound) {
+    std::cout << "H0 accepted: candidate is not stronger by more than " << arg_elo0 << " Elo." << std::endl;
+  } else {
+    std::cout << "Inconclusive: maximum number of pairs reached." << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
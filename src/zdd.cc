@@ -0,0 +1,334 @@
+#include "zdd.h"
+#include "counters.h"
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <utility>
+
+namespace {
+
+// Node keys in the unique table pack the variable (10 bits) and the two
+// children (Zdd::node_bits each).
+uint64_t NodeKey(int var, Zdd::node_t lo, Zdd::node_t hi) {
+  return (uint64_t) var | (uint64_t) lo << 10 | (uint64_t) hi << (10 + Zdd::node_bits);
+}
+
+// Builds the ZDD of the solutions of a state (see BuildSolutionZdd()).
+class SolutionZddBuilder {
+public:
+  SolutionZddBuilder(Zdd &zdd, const State &state, size_t max_nodes)
+      : zdd(zdd), max_nodes(max_nodes) {
+    assert(max_nodes <= Zdd::max_node_count);
+    for (int i = 0; i < 81; ++i) {
+      if (state.IsFree(i)) {
+        cells.push_back(i);
+        masks.push_back(state.CellUnused(i));
+      }
+    }
+    later_peers.resize(cells.size());
+    for (size_t k = 0; k < cells.size(); ++k) {
+      for (size_t j = k + 1; j < cells.size(); ++j) {
+        if (IsPeer(cells[k], cells[j])) later_peers[k].push_back(j);
+      }
+    }
+  }
+
+  std::optional<Zdd::node_t> Build() {
+    Zdd::node_t root = Build(0);
+    if (aborted) return {};
+    return root;
+  }
+
+private:
+  static bool IsPeer(int i, int j) {
+    return i / 9 == j / 9 || i % 9 == j % 9 ||
+        (i / 27 == j / 27 && i % 9 / 3 == j % 9 / 3);
+  }
+
+  // Returns the ZDD of the assignments to cells[k:] that are consistent with
+  // their candidates.
+  Zdd::node_t Build(size_t k) {
+    if (aborted) return Zdd::empty;
+    if (k == cells.size()) return Zdd::base;
+
+    // The candidates of the remaining cells determine the result, and since
+    // the length of the key implies k, no separate key is needed per cell.
+    std::string key(reinterpret_cast<const char *>(&masks[k]),
+        sizeof(masks[0]) * (cells.size() - k));
+    if (auto it = memo.find(key); it != memo.end()) return it->second;
+
+    Zdd::node_t children[10] = {};
+    for (int digit = 1; digit <= 9; ++digit) {
+      const uint16_t bit = 1u << digit;
+      if ((masks[k] & bit) == 0) continue;
+      // Remove the digit from the candidates of later peers, unless that
+      // leaves one without candidates.
+      size_t changed[20];
+      size_t changed_size = 0;
+      bool dead = false;
+      for (size_t j : later_peers[k]) {
+        if (masks[j] & bit) {
+          masks[j] ^= bit;
+          changed[changed_size++] = j;
+          if (masks[j] == 0) dead = true;
+        }
+      }
+      if (!dead) children[digit] = Build(k + 1);
+      for (size_t i = 0; i < changed_size; ++i) masks[changed[i]] ^= bit;
+    }
+
+    // Check the limit before creating up to 9 nodes, so that the ZDD never
+    // exceeds it.
+    if (aborted || zdd.NodeCount() + 9 > max_nodes || memo.size() >= max_nodes) {
+      aborted = true;
+      return Zdd::empty;
+    }
+    Zdd::node_t result = Zdd::empty;
+    for (int digit = 9; digit >= 1; --digit) {
+      if (children[digit] != Zdd::empty) {
+        result = zdd.MakeNode(Zdd::Var(Move{.pos = cells[k], .digit = digit}), result, children[digit]);
+      }
+    }
+    memo.emplace(std::move(key), result);
+    return result;
+  }
+
+  Zdd &zdd;
+  size_t max_nodes;
+  bool aborted = false;
+
+  // Free cells in order, with their candidates (as in State::CellUnused()),
+  // and for each, the indices of the free cells after it that are its peers.
+  std::vector<int> cells;
+  std::vector<uint16_t> masks;
+  std::vector<std::vector<size_t>> later_peers;
+
+  std::unordered_map<std::string, Zdd::node_t> memo;
+};
+
+}  // namespace
+
+Zdd::Zdd() {
+  nodes.push_back(Node{.var = var_count, .lo = empty, .hi = empty});
+  nodes.push_back(Node{.var = var_count, .lo = empty, .hi = empty});
+  counts = {0, 1};
+}
+
+Zdd::node_t Zdd::MakeNode(int var, node_t lo, node_t hi) {
+  assert(var >= 0 && var < var_count);
+  assert(var < Var(lo) && var < Var(hi));
+  if (hi == empty) return lo;
+  auto [it, inserted] = unique_table.try_emplace(NodeKey(var, lo, hi), nodes.size());
+  if (inserted) {
+    assert(nodes.size() < max_node_count);
+    nodes.push_back(Node{.var = (uint16_t) var, .lo = lo, .hi = hi});
+    counts.push_back(0);
+  }
+  return it->second;
+}
+
+size_t Zdd::MemoryUsage() const {
+  // Hash table entries are estimated at twice the size of their contents,
+  // to account for buckets and allocation overhead.
+  return nodes.capacity() * sizeof(Node) +
+      counts.capacity() * sizeof(uint64_t) +
+      path_counts.capacity() * sizeof(uint64_t) +
+      visited.capacity() * sizeof(uint32_t) +
+      (order.capacity() + stack.capacity()) * sizeof(node_t) +
+      (unique_table.size() + restrict_cache.size()) * 2 * sizeof(std::pair<uint64_t, node_t>);
+}
+
+uint64_t Zdd::Count(node_t n) {
+  if (n == empty || counts[n] != 0) return counts[n];
+  uint64_t count = Count(Lo(n)) + Count(Hi(n));
+  counts[n] = count;
+  return count;
+}
+
+Zdd::node_t Zdd::Restrict(node_t n, int var, int64_t &work_left, size_t max_nodes) {
+  assert(max_nodes <= max_node_count);
+  if (work_left < 0) return empty;  // Aborted.
+  if (Var(n) > var) return empty;  // includes the terminals
+  if (Var(n) < var) {
+    const uint64_t key = (uint64_t) n << 10 | var;
+    if (auto it = restrict_cache.find(key); it != restrict_cache.end()) return it->second;
+    --work_left;
+    node_t lo = Restrict(Lo(n), var, work_left, max_nodes);
+    node_t hi = Restrict(Hi(n), var, work_left, max_nodes);
+    if (work_left < 0) return empty;  // Don't cache incomplete results.
+    if (nodes.size() >= max_nodes) {
+      work_left = -1;
+      return empty;
+    }
+    node_t result = MakeNode(Var(n), lo, hi);
+    restrict_cache.emplace(key, result);
+    return result;
+  }
+  if (nodes.size() >= max_nodes) {
+    work_left = -1;
+    return empty;
+  }
+  return MakeNode(var, empty, Hi(n));
+}
+
+size_t Zdd::CountVars(node_t root, uint64_t (&var_counts)[var_count]) {
+  std::fill(std::begin(var_counts), std::end(var_counts), 0);
+  if (visited.size() < nodes.size()) {
+    visited.resize(nodes.size());
+    path_counts.resize(nodes.size());
+  }
+  if (++visit_generation == 0) {
+    std::fill(visited.begin(), visited.end(), 0);
+    visit_generation = 1;
+  }
+
+  // Collect the internal nodes reachable from the root. Since variables
+  // increase along edges, ordering them by variable is a topological order.
+  order.clear();
+  stack.assign(1, root);
+  while (!stack.empty()) {
+    node_t n = stack.back();
+    stack.pop_back();
+    if (n <= base || visited[n] == visit_generation) continue;
+    visited[n] = visit_generation;
+    path_counts[n] = 0;
+    order.push_back(n);
+    stack.push_back(Lo(n));
+    stack.push_back(Hi(n));
+  }
+  std::sort(order.begin(), order.end(),
+      [this](node_t a, node_t b) { return Var(a) < Var(b); });
+
+  // Count the paths from the root to each node. Every set that contains the
+  // variable of a node corresponds to a path to the node, followed by a set
+  // of its high child.
+  if (root > base) path_counts[root] = 1;
+  for (node_t n : order) {
+    const uint64_t paths = path_counts[n];
+    var_counts[Var(n)] += paths * Count(Hi(n));
+    if (Lo(n) > base) path_counts[Lo(n)] += paths;
+    if (Hi(n) > base) path_counts[Hi(n)] += paths;
+  }
+  return order.size();
+}
+
+std::optional<Zdd::node_t> BuildSolutionZdd(Zdd &zdd, const State &state, size_t max_nodes) {
+  return SolutionZddBuilder(zdd, state, max_nodes).Build();
+}
+
+ZddAnalyzer::ZddAnalyzer(Zdd &zdd, size_t max_nodes) : zdd(zdd), max_nodes(max_nodes) {
+  assert(max_nodes <= Zdd::max_node_count);
+}
+
+AnalyzeResult ZddAnalyzer::Analyze(Zdd::node_t root, int max_winning_moves, int64_t max_work) {
+  assert(max_winning_moves > 0);
+  const uint64_t total = zdd.Count(root);
+  assert(total > 0);
+
+  if (total == 1) {
+    // Solution is already unique.
+    return AnalyzeResult{Outcome::WIN1, {Turn(true)}, 1};
+  }
+
+  counters.recursive_calls.Inc();
+  uint64_t var_counts[Zdd::var_count];
+  int64_t work_left = max_work - zdd.CountVars(root, var_counts);
+
+  // If there is an immediately winning move, always take it!
+  std::vector<Turn> immediately_winning;
+  for (int var = 0; var < Zdd::var_count; ++var) {
+    if (var_counts[var] == 1) immediately_winning.push_back(Turn(Zdd::VarMove(var), true));
+  }
+  if (!immediately_winning.empty()) {
+    return AnalyzeResult{Outcome::WIN1, immediately_winning, max_work - work_left};
+  }
+
+  std::vector<std::pair<uint64_t, int>> moves;
+  for (int var = 0; var < Zdd::var_count; ++var) {
+    if (var_counts[var] > 0 && var_counts[var] < total) moves.push_back({var_counts[var], var});
+  }
+  std::sort(moves.begin(), moves.end());
+
+  std::vector<Turn> losing_turns;
+  std::vector<Turn> winning_turns;
+  for (auto [count, var] : moves) {
+    Zdd::node_t child = zdd.Restrict(root, var, work_left, max_nodes);
+    if (work_left < 0) {
+      return AnalyzeResult{.outcome = {}, .optimal_turns = {}, .work = max_work};  // Search aborted.
+    }
+    counters.max_depth.Inc();
+    bool next_winning = IsWinning(child, work_left);
+    counters.max_depth.Dec();
+    if (work_left < 0) {
+      return AnalyzeResult{.outcome = {}, .optimal_turns = {}, .work = max_work};  // Search aborted.
+    }
+    if (next_winning) {
+      losing_turns.push_back(Turn(Zdd::VarMove(var)));
+    } else {
+      winning_turns.push_back(Turn(Zdd::VarMove(var)));
+      if (winning_turns.size() >= (size_t) max_winning_moves) break;
+    }
+  }
+  const int64_t work = max_work - work_left;
+  if (!winning_turns.empty()) return AnalyzeResult{Outcome::WIN2, winning_turns, work};
+  return AnalyzeResult{Outcome::LOSS, losing_turns, work};
+}
+
+bool ZddAnalyzer::IsWinning(Zdd::node_t n, int64_t &work_left) {
+  counters.recursive_calls.Inc();
+
+  // Check memo for cached result.
+  counters.memo_accessed.Inc();
+  if (status.size() < zdd.NodeCount()) status.resize(zdd.NodeCount());
+  if (status[n] != 0) {
+    counters.memo_returned.Inc();
+    return status[n] == 2;
+  }
+
+  uint64_t var_counts[Zdd::var_count];
+  work_left -= zdd.CountVars(n, var_counts);
+  if (work_left < 0) return false;  // Search aborted.
+
+  // Detect immediately winning moves.
+  for (int var = 0; var < Zdd::var_count; ++var) {
+    if (var_counts[var] == 1) {
+      // Immediately winning!
+      counters.immediately_won.Inc();
+      status[n] = 2;
+      return true;
+    }
+  }
+
+  // Generate moves on top of the moves of the parent positions. Since the
+  // recursive calls below may reallocate move_stack, the moves of this
+  // position are accessed by index.
+  const uint64_t total = zdd.Count(n);
+  const size_t moves_begin = move_stack.size();
+  for (int var = 0; var < Zdd::var_count; ++var) {
+    const uint64_t count = var_counts[var];
+    if (count > 0 && count < total) move_stack.push_back({count, var});
+  }
+  const size_t moves_end = move_stack.size();
+  std::sort(move_stack.begin() + moves_begin, move_stack.end());
+
+  // Moves that select the same subset of solutions lead to the same node, so
+  // after the first of them is searched, the others are answered by the memo.
+  bool winning = false;
+  for (size_t i = moves_begin; i < moves_end; ++i) {
+    Zdd::node_t child = zdd.Restrict(n, move_stack[i].second, work_left, max_nodes);
+    if (work_left < 0) break;  // Search aborted.
+    counters.max_depth.Inc();
+    bool next_losing = !IsWinning(child, work_left);
+    counters.max_depth.Dec();
+    if (work_left < 0) break;  // Search aborted.
+    if (next_losing) {
+      winning = true;
+      break;
+    }
+  }
+  move_stack.resize(moves_begin);
+  if (work_left < 0) return false;  // Search aborted.
+  status[n] = winning ? 2 : 1;
+  return winning;
+}
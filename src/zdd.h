@@ -0,0 +1,151 @@
+// Solution sets as zero-suppressed decision diagrams (ZDDs).
+//
+// A solution is represented by the set of variables 9*pos + (digit - 1) for
+// its free cells, and a solution set by a reduced, ordered ZDD over these 729
+// variables. Nodes are created through a unique table, so equal subfamilies
+// are always represented by the same node. This has three consequences:
+//
+//  - Solution sets that have a lot of structure (for example, cells whose
+//    digits do not depend on the rest of the grid) take much less memory
+//    than explicit lists of solutions.
+//
+//  - Selecting the solutions with a given digit at a given position (playing
+//    a move) is a restriction, which only creates new nodes above the level
+//    of the move's variable, and solution counts are calculated by dynamic
+//    programming over nodes instead of by scanning solutions.
+//
+//  - A node identifies a solution set exactly, so it can be used as a memo
+//    key without hashing, and without collisions.
+//
+// BuildSolutionZdd() constructs the ZDD directly while enumerating, without
+// listing solutions, and ZddAnalyzer determines outcomes like Analyze() does.
+// The solver exposes this with --engine=zdd.
+
+#ifndef ZDD_H_INCLUDED
+#define ZDD_H_INCLUDED
+
+#include "analysis.h"
+#include "state.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class Zdd {
+public:
+  using node_t = uint32_t;
+
+  // Terminal nodes: the empty family, and the family containing only the
+  // empty set.
+  static constexpr node_t empty = 0;
+  static constexpr node_t base = 1;
+
+  static constexpr int var_count = 729;
+
+  // Maximum number of nodes (including the terminals), since node keys in the
+  // unique table pack each child into 27 bits.
+  static constexpr int node_bits = 27;
+  static constexpr size_t max_node_count = size_t{1} << node_bits;
+
+  static constexpr int Var(const Move &move) { return 9*move.pos + (move.digit - 1); }
+  static constexpr Move VarMove(int var) { return Move{.pos = var / 9, .digit = var % 9 + 1}; }
+
+  Zdd();
+
+  // Returns the node for the family (sets of lo) + (sets of hi, with `var`
+  // added). Variables must increase from a node to its children.
+  node_t MakeNode(int var, node_t lo, node_t hi);
+
+  int Var(node_t n) const { return nodes[n].var; }
+  node_t Lo(node_t n) const { return nodes[n].lo; }
+  node_t Hi(node_t n) const { return nodes[n].hi; }
+
+  // Number of nodes (including the terminals).
+  size_t NodeCount() const { return nodes.size(); }
+
+  // Approximate number of bytes used by nodes and tables.
+  size_t MemoryUsage() const;
+
+  // Returns the number of sets in the family (modulo 2^64).
+  uint64_t Count(node_t n);
+
+  // Returns the subfamily of sets that contain `var`. Each node visited that
+  // is not cached costs one unit of work. If work_left becomes negative, or if
+  // the number of nodes would exceed max_nodes (at most max_node_count),
+  // work_left is set to a negative value and the result is meaningless.
+  node_t Restrict(node_t n, int var, int64_t &work_left, size_t max_nodes);
+
+  // Calculates for each variable the number of sets of the family that
+  // contain it. Returns the number of nodes visited, which is the cost of
+  // the calculation.
+  size_t CountVars(node_t n, uint64_t (&var_counts)[var_count]);
+
+private:
+  struct Node {
+    uint16_t var;  // var_count for the terminals
+    node_t lo;
+    node_t hi;
+  };
+
+  std::vector<Node> nodes;
+  std::unordered_map<uint64_t, node_t> unique_table;
+  std::unordered_map<uint64_t, node_t> restrict_cache;
+
+  // Count() per node, or 0 if not calculated yet (every nonempty family has a
+  // positive count, so 0 is only ambiguous for the empty terminal).
+  std::vector<uint64_t> counts;
+
+  // Scratch space for CountVars(), indexed by node.
+  std::vector<uint64_t> path_counts;
+  std::vector<uint32_t> visited;
+  uint32_t visit_generation = 0;
+
+  // Scratch space for CountVars(), reused to avoid allocations.
+  std::vector<node_t> order;
+  std::vector<node_t> stack;
+};
+
+// Builds the ZDD of all solutions of `state`, over its free cells. Returns an
+// empty optional if the ZDD would exceed `max_nodes` nodes (which must be at
+// most Zdd::max_node_count).
+//
+// Cells are filled in a fixed order. The solutions of the remaining cells
+// only depend on their candidate digits, so those are used as a key to share
+// subdiagrams between different assignments of the earlier cells.
+std::optional<Zdd::node_t> BuildSolutionZdd(Zdd &zdd, const State &state, size_t max_nodes);
+
+// Determines the outcome of the game for solution sets represented by ZDD
+// nodes, with the same move ordering as Analyze() (increasing solution count,
+// skipping moves that select the same subset as an earlier move). Results
+// are memoized per node, for as long as the analyzer exists.
+//
+// Work is measured in ZDD nodes visited, rather than in solutions. Analysis
+// also creates nodes (for the solution sets after each move), and is aborted
+// like when the work limit is reached if the ZDD would exceed `max_nodes`
+// nodes (at most Zdd::max_node_count).
+class ZddAnalyzer {
+public:
+  explicit ZddAnalyzer(Zdd &zdd, size_t max_nodes = Zdd::max_node_count);
+
+  // Same as Analyze(), for the solution set represented by `root`.
+  AnalyzeResult Analyze(Zdd::node_t root, int max_winning_moves, int64_t max_work = 1e18);
+
+private:
+  bool IsWinning(Zdd::node_t n, int64_t &work_left);
+
+  Zdd &zdd;
+  size_t max_nodes;
+
+  // Memoized results per node: 0 for unknown, 1 for losing, 2 for winning.
+  std::vector<uint8_t> status;
+
+  // Moves of the positions on the current search path, as (solution count,
+  // variable) pairs. Each call of IsWinning() appends its moves, and removes
+  // them before returning, so the buffer is only allocated once.
+  std::vector<std::pair<uint64_t, int>> move_stack;
+};
+
+#endif  // ndef ZDD_H_INCLUDED
@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+#
+# End-to-end benchmark of the solver over fixed subsets of the data/ corpora.
+#
+# Each suite runs a fixed number of cases through enumeration and analysis
+# (using the solver's batch mode), checks the outcomes against the stored
+# *-outcomes.txt files, and reports throughput. Results are written as JSON.
+#
+# Usage:
+#
+#   tools/bench.py --output=output/bench.json
+#   tools/bench.py --output=output/bench-new.json --compare=output/bench.json
+#
+# In comparison mode, the exit status is nonzero if any outcome is incorrect,
+# or if any rate dropped by more than --threshold relative to the baseline.
+#
+# Usually invoked through `make bench` (optionally with BENCH_BASELINE=...).
+
+import argparse
+from datetime import datetime
+import json
+import os.path
+import subprocess
+import sys
+
+
+# Suites: (name, cases file, outcomes file, number of cases)
+SUITES = [
+  ('2k',  'data/random-play-until-2k-cases.txt',  'data/random-play-until-2k-outcomes.txt',  100),
+  ('10k', 'data/random-play-until-10k-cases.txt', 'data/random-play-until-10k-outcomes.txt',  20),
+]
+
+# Metrics where higher is better. These are compared against the baseline.
+RATES = ['cases_per_sec', 'solutions_per_sec', 'nodes_per_sec']
+
+
+def ReadCases(filename, count):
+  # Format: <case number> <given count> <grid>
+  with open(filename, 'rt') as f:
+    return [line.split()[2] for line in f][:count]
+
+
+def ReadOutcomes(filename, count):
+  # Format: <line number> Outcome: <outcome>
+  with open(filename, 'rt') as f:
+    return [line.split()[2] for line in f][:count]
+
+
+def GitCommit():
+  try:
+    return subprocess.run(['git', 'rev-parse', '--short', 'HEAD'],
+        capture_output=True, text=True, check=True).stdout.strip()
+  except (OSError, subprocess.CalledProcessError):
+    return None
+
+
+def RunSuite(solver, memo_size, cases_file, outcomes_file, count):
+  cases = ReadCases(cases_file, count)
+  expected = ReadOutcomes(outcomes_file, count)
+  command = [solver, '--jobs=1', '-']
+  if memo_size:
+    command.insert(1, '--memo-size=%d' % memo_size)
+  output = subprocess.run(command, input='\n'.join(cases) + '\n',
+      capture_output=True, text=True, check=True).stdout
+
+  seconds = 0.0
+  solutions = 0
+  work = 0
+  nodes = 0
+  memo_lookups = 0
+  memo_hits = 0
+  mismatches = []
+  for line in output.splitlines():
+    fields = line.split('\t')
+    i = int(fields[0]) - 1
+    outcome = fields[1]
+    if outcome != expected[i]:
+      mismatches.append({'case': i, 'expected': expected[i], 'actual': outcome})
+    solutions += int(fields[2].rstrip('+')) if fields[2] != '-' else 0
+    work += int(fields[4])
+    seconds += float(fields[5])
+    nodes += int(fields[6])
+    memo_lookups += int(fields[7])
+    memo_hits += int(fields[8])
+
+  seconds = max(seconds, 1e-9)
+  return {
+    'cases': len(cases),
+    'seconds': seconds,
+    'solutions': solutions,
+    'work': work,
+    'nodes': nodes,
+    'cases_per_sec': len(cases) / seconds,
+    'solutions_per_sec': solutions / seconds,
+    'nodes_per_sec': nodes / seconds,
+    'memo_hit_rate': memo_hits / memo_lookups if memo_lookups else 0.0,
+    'mismatches': mismatches,
+  }
+
+
+def PrintSuite(name, result):
+  print('%-4s %4d cases %8.3f s %9.1f cases/s %12.0f solutions/s %12.0f nodes/s %6.2f%% memo hits' % (
+      name, result['cases'], result['seconds'], result['cases_per_sec'],
+      result['solutions_per_sec'], result['nodes_per_sec'], 100*result['memo_hit_rate']))
+  for m in result['mismatches']:
+    print('     case %d: expected %s, got %s' % (m['case'], m['expected'], m['actual']))
+
+
+def Compare(results, baseline, threshold):
+  '''Returns a list of regression descriptions (empty if there are none).'''
+  regressions = []
+  for name, result in results['suites'].items():
+    base = baseline['suites'].get(name)
+    if base is None:
+      continue
+    for rate in RATES:
+      old, new = base[rate], result[rate]
+      change = new / old - 1 if old else 0.0
+      flag = ''
+      if change < -threshold:
+        flag = '  REGRESSION'
+        regressions.append('%s %s: %.1f -> %.1f (%+.1f%%)' % (name, rate, old, new, 100*change))
+      print('%-4s %-18s %14.1f -> %14.1f (%+6.1f%%)%s' % (name, rate, old, new, 100*change, flag))
+    old, new = base['memo_hit_rate'], result['memo_hit_rate']
+    print('%-4s %-18s %13.2f%% -> %13.2f%%' % (name, 'memo_hit_rate', 100*old, 100*new))
+  return regressions
+
+
+def Main():
+  parser = argparse.ArgumentParser(prog='bench.py')
+  parser.add_argument('--solver', type=str, default='output/release/solver',
+      help='solver binary to benchmark')
+  parser.add_argument('--memo-size', type=int, default=0,
+      help='memo size passed to the solver (or 0 for its default)')
+  parser.add_argument('--output', type=str, default=None,
+      help='JSON file to write results to')
+  parser.add_argument('--compare', type=str, default=None,
+      help='JSON file with baseline results to compare against')
+  parser.add_argument('--threshold', type=float, default=0.05,
+      help='relative slowdown that is reported as a regression')
+  args = parser.parse_args()
+
+  basedir = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+
+  # Read the baseline first, since it may be the same file as the output.
+  baseline = None
+  if args.compare:
+    with open(args.compare, 'rt') as f:
+      baseline = json.load(f)
+
+  results = {
+    'solver': args.solver,
+    'commit': GitCommit(),
+    'date': datetime.now().isoformat(timespec='seconds'),
+    'suites': {},
+  }
+  failed = False
+  for name, cases_file, outcomes_file, count in SUITES:
+    result = RunSuite(args.solver, args.memo_size,
+        os.path.join(basedir, cases_file), os.path.join(basedir, outcomes_file), count)
+    results['suites'][name] = result
+    PrintSuite(name, result)
+    if result['mismatches']:
+      failed = True
+
+  if args.output:
+    with open(args.output, 'wt') as f:
+      json.dump(results, f, indent=2)
+      f.write('\n')
+
+  if baseline:
+    print()
+    print('Compared to %s (commit %s):' % (args.compare, baseline.get('commit')))
+    regressions = Compare(results, baseline, args.threshold)
+    if regressions:
+      print()
+      print('Regressions (more than %.0f%% slower):' % (100*args.threshold))
+      for r in regressions:
+        print('  ' + r)
+      failed = True
+
+  if failed:
+    sys.exit(1)
+
+
+if __name__ == '__main__':
+  Main()